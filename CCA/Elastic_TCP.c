@@ -1,33 +1,372 @@
 #include <linux/module.h>
+#include <linux/jump_label.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/timex.h>
+#include <linux/version.h>
+#include <linux/win_minmax.h>
 #include <net/tcp.h>
 
-#ifdef _TCP_ELASTIC_H  
-#define SCALE 100
-#else
-#define _TCP_ELASTIC_H
-#define SCALE 1
+//AI增量的定点小数位数：gap和snd_cwnd_cnt都以1/256个包为单位;
+#define ELASTIC_FRAC_BITS	8
+
+/* bench=N时在模块加载时跑N次增长计算的基准测试，结果打印到dmesg;
+ * 只在make TCP_ELASTIC_BENCH=y编译时才有，正常的模块里没有基准测试的代码;
+ */
+#ifdef TCP_ELASTIC_BENCH
+static unsigned int bench __read_mostly;
+module_param(bench, uint, 0444);
+MODULE_PARM_DESC(bench, "iterations of the growth benchmark run at load (0 = off)");
 #endif
 
+/* AI增长规律: sqrt(cwnd*maxRTT/curRTT)、log2(cwnd*maxRTT/curRTT)，
+ * 或者linear(每个RTT加一个包，和reno一样);
+ * "elastic_sqrt"/"elastic_log"/"elastic_linear"固定一种，按名字给单个socket选;
+ * "elastic"和"elastic_pacing"用growth参数选的那一种，可以在运行时改;
+ * 切换用static key把跳转直接改写到代码里，每个ACK不多一次分支或间接调用;
+ */
+enum elastic_growth {
+	ELASTIC_GROWTH_SQRT,
+	ELASTIC_GROWTH_LOG,
+	ELASTIC_GROWTH_LINEAR,
+};
+
+static const char * const elastic_growth_names[] = {
+	[ELASTIC_GROWTH_SQRT]	= "sqrt",
+	[ELASTIC_GROWTH_LOG]	= "log",
+	[ELASTIC_GROWTH_LINEAR]	= "linear",
+};
+
+static DEFINE_STATIC_KEY_FALSE(elastic_growth_log);
+static DEFINE_STATIC_KEY_FALSE(elastic_growth_linear);
+static int elastic_growth = ELASTIC_GROWTH_SQRT;
+
+static int elastic_growth_set(const char *val, const struct kernel_param *kp)
+{
+	int g = sysfs_match_string(elastic_growth_names, val);
+
+	if (g < 0)
+		return g;
+
+	if (g == ELASTIC_GROWTH_LOG)
+		static_branch_enable(&elastic_growth_log);
+	else
+		static_branch_disable(&elastic_growth_log);
+	if (g == ELASTIC_GROWTH_LINEAR)
+		static_branch_enable(&elastic_growth_linear);
+	else
+		static_branch_disable(&elastic_growth_linear);
+	elastic_growth = g;
+	return 0;
+}
+
+static int elastic_growth_get(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%s\n", elastic_growth_names[elastic_growth]);
+}
+
+static const struct kernel_param_ops elastic_growth_ops = {
+	.set	= elastic_growth_set,
+	.get	= elastic_growth_get,
+};
+module_param_cb(growth, &elastic_growth_ops, NULL, 0644);
+MODULE_PARM_DESC(growth, "growth law of \"elastic\" and \"elastic_pacing\": sqrt, log or linear");
+
+//baseRTT和maxRTT滑动窗口的长度，单位是RTT轮数，按baseRTT换算成时间;
+static unsigned int basertt_win_rounds __read_mostly = 100;
+module_param(basertt_win_rounds, uint, 0644);
+MODULE_PARM_DESC(basertt_win_rounds, "baseRTT filter window in round trips");
+static unsigned int maxrtt_win_rounds __read_mostly = 10;
+module_param(maxrtt_win_rounds, uint, 0644);
+MODULE_PARM_DESC(maxrtt_win_rounds, "maxRTT filter window in round trips");
+
+//"elastic_pacing"的发送速率 = gain% * cwnd * mss / RTT，慢启动和拥塞避免分开设增益;
+static unsigned int pacing_ss_gain __read_mostly = 200;
+module_param(pacing_ss_gain, uint, 0644);
+MODULE_PARM_DESC(pacing_ss_gain, "elastic_pacing rate gain in slow start (percent)");
+static unsigned int pacing_ca_gain __read_mostly = 120;
+module_param(pacing_ca_gain, uint, 0644);
+MODULE_PARM_DESC(pacing_ca_gain, "elastic_pacing rate gain in congestion avoidance (percent)");
+//0: 用平滑RTT(srtt)，1: 用最近一个ACK的RTT(currtt);
+static unsigned int pacing_rtt __read_mostly;
+module_param(pacing_rtt, uint, 0644);
+MODULE_PARM_DESC(pacing_rtt, "elastic_pacing RTT: 0 = smoothed, 1 = current");
+
+//HyStart: 慢启动里检测到ACK train或RTT上升时提前退出，参数和tcp_cubic一致;
+#define HYSTART_ACK_TRAIN	0x1
+#define HYSTART_DELAY		0x2
+//每轮取前8个RTT样本的最小值;
+#define HYSTART_MIN_SAMPLES	8
+#define HYSTART_DELAY_MIN	(4000U)	/* 4 ms */
+#define HYSTART_DELAY_MAX	(16000U)	/* 16 ms */
+#define HYSTART_DELAY_THRESH(x)	clamp(x, HYSTART_DELAY_MIN, HYSTART_DELAY_MAX)
+
+static bool hystart __read_mostly = true;
+module_param(hystart, bool, 0644);
+MODULE_PARM_DESC(hystart, "turn on/off hybrid slow start algorithm");
+static int hystart_detect __read_mostly = HYSTART_ACK_TRAIN | HYSTART_DELAY;
+module_param(hystart_detect, int, 0644);
+MODULE_PARM_DESC(hystart_detect, "hybrid slow start detection mechanisms"
+		 " 1: packet-train 2: delay 3: both packet-train and delay");
+static int hystart_low_window __read_mostly = 16;
+module_param(hystart_low_window, int, 0644);
+MODULE_PARM_DESC(hystart_low_window, "lower bound cwnd for hybrid slow start");
+static int hystart_ack_delta_us __read_mostly = 2000;
+module_param(hystart_ack_delta_us, int, 0644);
+MODULE_PARM_DESC(hystart_ack_delta_us, "spacing between ack's indicating train (usecs)");
+
+/* 丢包时ssthresh = 估计的BDP = 交付速率 * baseRTT(和Westwood的
+ * tcp_westwood_bw_rttmin一样)，但不低于cwnd的bdp_min_pct%，也不超过cwnd;
+ * 交付速率以包/us为单位，左移BW_SCALE位;
+ */
+#define BW_SCALE	24
+static bool bdp_ssthresh __read_mostly = true;
+module_param(bdp_ssthresh, bool, 0644);
+MODULE_PARM_DESC(bdp_ssthresh, "set ssthresh to the estimated BDP on loss (0 = halve like reno)");
+static unsigned int bdp_min_pct __read_mostly = 50;
+module_param(bdp_min_pct, uint, 0644);
+MODULE_PARM_DESC(bdp_min_pct, "lower bound of the BDP ssthresh, percent of cwnd");
+
+/* ACK聚合(GRO/LRO、Wi-Fi聚合、ACK压缩)：一个ACK确认的包，如果到达得比按交付速率
+ * 应有的间隔快ack_agg_ratio倍以上，就认为和上一个ACK属于同一个ACK簇;
+ * 簇里的ACK被缓存过，RTT样本偏大，只有簇内最小的RTT是无偏的;
+ */
+static unsigned int ack_agg_ratio __read_mostly = 2;
+module_param(ack_agg_ratio, uint, 0644);
+MODULE_PARM_DESC(ack_agg_ratio, "an ACK arriving this many times faster than the delivery rate joins the current ACK clump (0 = off)");
+
+/* "elastic_dctcp"是数据中心模式：协商ECN，拥塞时像DCTCP一样按被CE标记的
+ * 比例减窗，cwnd -= cwnd * alpha / 2，而不是reno的减半;增长规律不变;
+ * alpha是每轮CE比例的EWMA，增益1/2^dctcp_shift_g，以1/1024为单位;
+ */
+#define DCTCP_MAX_ALPHA	1024U
+static unsigned int dctcp_shift_g __read_mostly = 4; /* g = 1/2^4 */
+module_param(dctcp_shift_g, uint, 0644);
+MODULE_PARM_DESC(dctcp_shift_g, "parameter g for updating dctcp_alpha");
+static unsigned int dctcp_alpha_on_init __read_mostly = DCTCP_MAX_ALPHA;
+module_param(dctcp_alpha_on_init, uint, 0644);
+MODULE_PARM_DESC(dctcp_alpha_on_init, "parameter for initial alpha value");
+
 struct elastic{
-	u32	ai;
-	u32	maxrtt;
+	//最近一个ACK簇里最小的RTT;
 	u32	currtt;
-	u32 basertt;
+	//snd_una越过round_end时过了一轮;
+	u32	round_end;
+	//上一个ACK处理完时的snd_una，elastic_pacing用来判断累计确认是否前移;
+	u32	last_snd_una;
+	//以us为时间的滑动窗口最小/最大RTT(lib/win_minmax);
+	struct minmax basertt;
+	struct minmax maxrtt;
+	//本轮开始和上一个ACK到达的时间(us);
+	u32	round_start;
+	u32	last_ack;
+	//HyStart每轮的状态：前8个样本的最小RTT，本轮的ACK是否一直紧密到达;
+	u32	curr_rtt;
+	//交付速率：本轮开始时的tp->delivered，和按轮平滑后的速率(BW_SCALE);
+	u32	round_delivered;
+	u32	bw;
+	/* elastic_dctcp，和tcp_dctcp的状态一样：snd_una越过next_seq时结束一个窗口，
+	 * 窗口开始时的tp->delivered/delivered_ce，接收端上次的rcv_nxt，CE比例的EWMA;
+	 * 整个结构不能超过104字节(ICSK_CA_PRIV_SIZE);
+	 */
+	u32	dctcp_next_seq;
+	u32	dctcp_old_delivered;
+	u32	dctcp_old_delivered_ce;
+	u32	dctcp_prior_rcv_nxt;
+	//丢包时maxRTT被重置的累计次数，只用于导出;
+	u32	loss_resets;
+	u16	dctcp_alpha;
+	u8	sample_cnt;
+	u8	found:2,
+		in_train:1,
+		ce_state:1,
+		unused:4;
+};
+
+/* 通过INET_DIAG_VEGASINFO导出的状态(ss -ti、netlink、TCP_CC_INFO)，RTT单位都是us;
+ * union tcp_cc_info只有20字节，正好放下增长规律的三个输入、gap和丢包重置次数;
+ * gap是每个RTT cwnd增加的包数，以1/256个包为单位，按socket所用的增长规律算;
+ * 字段顺序让按tcpvegas_info解码的工具(ss)读到的仍然说得通:
+ * tcpv_enabled = maxRTT(还没有样本或刚被丢包重置时为0，ss就不用它)，
+ * tcpv_rttcnt = 丢包重置次数，tcpv_rtt = currtt，tcpv_minrtt = baseRTT;
+ */
+struct tcp_elastic_info {
+	__u32	elastic_maxrtt;
+	__u32	elastic_loss_resets;
+	__u32	elastic_currtt;
+	__u32	elastic_basertt;
+	__u32	elastic_gap;
 };
 
+//sqrt(m+0.5)*16, m=16..63: 归一化后尾数的平方根种子;
+static const u8 elastic_sqrt_tab[48] = {
+	 65,  67,  69,  71,  72,  74,  76,  78,  79,  81,  82,  84,
+	 85,  87,  88,  90,  91,  93,  94,  95,  97,  98,  99, 101,
+	102, 103, 104, 106, 107, 108, 109, 110, 111, 113, 114, 115,
+	116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127,
+};
+
+/* 常数时间的64位整数平方根:
+ * x右移偶数位s，使尾数m落在[16,64)，查表得到sqrt(m)的种子，
+ * 再左移s/2位，最后做一次牛顿迭代;
+ * 种子误差<3%，一次迭代后误差<0.3%，没有循环;
+ */
+static u32 elastic_sqrt(u64 x)
+{
+	u64 y;
+	int s;
+
+	if (x < 16)
+		return int_sqrt((unsigned long)x);
+
+	s = (fls64(x) - 5) & ~1;
+	y = ((u64)elastic_sqrt_tab[(x >> s) - 16] << (s >> 1)) >> 4;
+	y = (y + div64_u64(x, y)) >> 1;
+
+	return min_t(u64, y, U32_MAX);
+}
+
+//log2(1+(i+0.5)/64)*256: 最高位之后6位尾数的对数;
+static const u8 elastic_log2_tab[64] = {
+	  3,   9,  14,  20,  25,  30,  36,  41,  46,  51,  56,  61,
+	 66,  71,  75,  80,  85,  89,  94,  98, 103, 107, 111, 116,
+	120, 124, 128, 132, 136, 140, 144, 148, 152, 155, 159, 163,
+	167, 170, 174, 178, 181, 185, 188, 192, 195, 198, 202, 205,
+	208, 212, 215, 218, 221, 224, 228, 231, 234, 237, 240, 243,
+	246, 249, 252, 255,
+};
+
+/* 常数时间的定点log2，结果以1/256为单位:
+ * 整数部分是最高位的位置ilog2(x)，小数部分用最高位后面的6位查表;
+ * 误差小于0.012，x==0时返回0;
+ */
+static u32 elastic_log2(u64 x)
+{
+	int k;
+
+	if (!x)
+		return 0;
+
+	k = ilog2(x);
+	return ((u32)k << ELASTIC_FRAC_BITS) +
+	       elastic_log2_tab[(x << (63 - k)) >> 57 & 63];
+}
+
+//cwnd*maxrtt/currtt的Q16定点值：maxrtt/currtt先按Q16计算，再乘cwnd，全程64位不溢出;
+static u64 elastic_bdp_ratio(u32 cwnd, u32 maxrtt, u32 currtt)
+{
+	u64 ratio = div_u64((u64)maxrtt << 16, max(currtt, 1U));
+
+	return (u64)cwnd * min_t(u64, ratio, U32_MAX);
+}
+
+/* 每个ACK的AI增量，以1/256个包为单位;
+ * sqrt: Q16的平方根正好是Q8;
+ * log: Q16的log2比实际值多16，减掉即可;
+ * linear: 固定一个包，即每个RTT cwnd加一;
+ */
+static u32 elastic_gap_sqrt(u32 cwnd, u32 maxrtt, u32 currtt)
+{
+	return elastic_sqrt(elastic_bdp_ratio(cwnd, maxrtt, currtt));
+}
+
+static u32 elastic_gap_log(u32 cwnd, u32 maxrtt, u32 currtt)
+{
+	u32 log = elastic_log2(elastic_bdp_ratio(cwnd, maxrtt, currtt));
+
+	return log > (16 << ELASTIC_FRAC_BITS) ? log - (16 << ELASTIC_FRAC_BITS) : 0;
+}
+
+static u32 elastic_gap_linear(u32 cwnd, u32 maxrtt, u32 currtt)
+{
+	return 1 << ELASTIC_FRAC_BITS;
+}
+
+//growth参数选择的规律，static key分支在运行时被改写成直接跳转;
+static __always_inline u32 elastic_gap(u32 cwnd, u32 maxrtt, u32 currtt)
+{
+	if (static_branch_unlikely(&elastic_growth_log))
+		return elastic_gap_log(cwnd, maxrtt, currtt);
+	if (static_branch_unlikely(&elastic_growth_linear))
+		return elastic_gap_linear(cwnd, maxrtt, currtt);
+	return elastic_gap_sqrt(cwnd, maxrtt, currtt);
+}
+
+//新的一轮开始;
+static void elastic_hystart_reset(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct elastic *ca = inet_csk_ca(sk);
+
+	ca->round_start = (u32)tp->tcp_mstamp;
+	ca->curr_rtt = ~0U;
+	ca->sample_cnt = 0;
+	ca->in_train = 1;
+}
+
+/* ACK train: 本轮的ACK一直紧密到达(间隔<=hystart_ack_delta_us)，并且持续了
+ * baseRTT/2以上，说明已经填满了管道;
+ * delay: 本轮前8个样本的最小RTT比baseRTT高出clamp(baseRTT/8, 4ms, 16ms);
+ * 任一条件成立就把ssthresh设为当前cwnd，离开慢启动进入Elastic的AI过程;
+ */
+static void elastic_hystart_update(struct sock *sk, u32 delay)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct elastic *ca = inet_csk_ca(sk);
+	u32 basertt = minmax_get(&ca->basertt);
+	u32 now = (u32)tp->tcp_mstamp;
+
+	//ACK间隔由elastic_rtt_calc检查，一旦超过hystart_ack_delta_us本轮就不再是train;
+	if (hystart_detect & HYSTART_ACK_TRAIN) {
+		if (ca->in_train && (s32)(now - ca->round_start) > basertt >> 1)
+			ca->found |= HYSTART_ACK_TRAIN;
+	}
+
+	if (hystart_detect & HYSTART_DELAY) {
+		if (ca->sample_cnt < HYSTART_MIN_SAMPLES) {
+			if (ca->curr_rtt > delay)
+				ca->curr_rtt = delay;
+			ca->sample_cnt++;
+		} else if (ca->curr_rtt > basertt +
+			   HYSTART_DELAY_THRESH(basertt >> 3)) {
+			ca->found |= HYSTART_DELAY;
+		}
+	}
+
+	if (ca->found)
+		tp->snd_ssthresh = tp->snd_cwnd;
+}
+
 static void elastic_init(struct sock *sk)
 {
 	struct elastic *ca = inet_csk_ca(sk);
 
-	ca->ai = 0;
-	ca->maxrtt = 0;
 	//因为ca->currrtt在拥塞避免阶段是余数，在内核里若在某种条件下;
 	//需要初始化elasticCCA,会出现异常。在初始化时用currtt=1来做替代;
 	ca->currtt = 1;
-	ca->basertt = 0x7fffffff;
+	ca->round_end = tcp_sk(sk)->snd_nxt;
+	ca->last_snd_una = tcp_sk(sk)->snd_una;
+	ca->round_delivered = tcp_sk(sk)->delivered;
+	ca->bw = 0;
+	ca->dctcp_next_seq = tcp_sk(sk)->snd_nxt;
+	ca->dctcp_old_delivered = tcp_sk(sk)->delivered;
+	ca->dctcp_old_delivered_ce = tcp_sk(sk)->delivered_ce;
+	ca->dctcp_prior_rcv_nxt = tcp_sk(sk)->rcv_nxt;
+	ca->dctcp_alpha = min(dctcp_alpha_on_init, DCTCP_MAX_ALPHA);
+	ca->ce_state = 0;
+	ca->loss_resets = 0;
+	ca->found = 0;
+	ca->last_ack = (u32)tcp_sk(sk)->tcp_mstamp;
+	elastic_hystart_reset(sk);
+	minmax_reset(&ca->basertt, ca->last_ack, 0x7fffffff);
+	minmax_reset(&ca->maxrtt, ca->last_ack, 0);
 }
 
-static void elastic_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+/* 增长规律gap_fn是编译期常量，每个cong_avoid入口都内联出自己的一份，
+ * 没有函数指针调用;
+ */
+static __always_inline void elastic_cong_avoid_growth(struct sock *sk, u32 acked,
+		u32 (*gap_fn)(u32 cwnd, u32 maxrtt, u32 currtt))
 {
 	//AI过程 目的是为了随着目标BDP的大小步调弹性调整;
 	struct tcp_sock *tp = tcp_sk(sk);
@@ -38,9 +377,10 @@ static void elastic_cong_avoid(struct sock *sk, u32 ack, u32 acked)
 		return;
 
 	//满开始，仍然是reno的cwnd=cwnd+1;
+	//stretch ACK跨过ssthresh时，tcp_slow_start返回没用完的acked，接着走AI过程;
 	if (tcp_in_slow_start(tp))
-		tcp_slow_start(tp, acked);
-	else {
+		acked = tcp_slow_start(tp, acked);
+	if (acked) {
 		/* tp->snd_cwnd/ca->currtt是实时吞吐量,ca->maxrtt是收集到的一个epoch的最大RTT;
 		*BDP=BtlBW*RTT/packet_size;
 		*AI增量 过程 依赖 实时BDPmax ;
@@ -48,28 +388,24 @@ static void elastic_cong_avoid(struct sock *sk, u32 ack, u32 acked)
 		*固有的buffer下排队时延是固定的，传播时延一定，即maxRTT有目标最大值;
 		*BDP是有最大值的;
 		*/
-		u32 gap = int_sqrt(tp->snd_cwnd*SCALE*SCALE*ca->maxrtt/ca->currtt);
+		u64 gap = gap_fn(tp->snd_cwnd, minmax_get(&ca->maxrtt), ca->currtt);
+		u64 w = (u64)tp->snd_cwnd << ELASTIC_FRAC_BITS;
 		//退出慢启动的acked,按照数量需要计算总的AI增量;
-		//处在拥塞避免状态下的，调用时acked==1;
-		gap *= acked;
-
+		//stretch ACK和聚合的ACK一次确认很多包，gap*acked一次算完，和逐个ACK累加等价;
 		//AI过程的计数器增加gap的窗口量 cwnd+=gap/cwnd;
-		tp->snd_cwnd_cnt += gap;
+		u64 cnt = tp->snd_cwnd_cnt + gap * acked;
+
 		//计数器大于上一个RTT的窗口时;cnt计数;
-		//因为从慢启动阶段的AI增量有可能会有多个cwnd的总量，这里将if改成while;
-		//为了应付慢启动退出的状况;
-		while (tp->snd_cwnd_cnt >= tp->snd_cwnd*SCALE) {
-			u32 remain = tp->snd_cwnd_cnt;
-			
-			tp->snd_cwnd_cnt -= tp->snd_cwnd*SCALE;
-			//报错情况下，值退出，下次再进行重复操作
-			//解决回环的问题
-			if (tp->snd_cwnd_cnt > remain) {
-				tp->snd_cwnd_cnt = remain;
-				break;
-			}
-			tp->snd_cwnd++;
+		//从慢启动退出时AI增量可能有多个cwnd的总量，一次除法算出增加的包数;
+		//和tcp_cong_avoid_ai一样，不超过snd_cwnd_clamp;
+		if (cnt >= w) {
+			u64 delta = div64_u64(cnt, w);
+
+			cnt -= delta * w;
+			tp->snd_cwnd = min_t(u64, tp->snd_cwnd + delta,
+					     tp->snd_cwnd_clamp);
 		}
+		tp->snd_cwnd_cnt = min_t(u64, cnt, U32_MAX);
 
 	/* 	 if (tp->snd_cwnd_cnt >= tp->snd_cwnd) {        
 	*				 线性增长计数器 >= 阈值; 
@@ -85,6 +421,27 @@ static void elastic_cong_avoid(struct sock *sk, u32 ack, u32 acked)
 	*/
 	    }
 	}
+
+static void elastic_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+{
+	elastic_cong_avoid_growth(sk, acked, elastic_gap);
+}
+
+static void elastic_sqrt_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+{
+	elastic_cong_avoid_growth(sk, acked, elastic_gap_sqrt);
+}
+
+static void elastic_log_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+{
+	elastic_cong_avoid_growth(sk, acked, elastic_gap_log);
+}
+
+static void elastic_linear_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+{
+	elastic_cong_avoid_growth(sk, acked, elastic_gap_linear);
+}
+
 //ACKed时的RTT统计消息;
 
 // struct ack_sample {
@@ -93,26 +450,153 @@ static void elastic_cong_avoid(struct sock *sk, u32 ack, u32 acked)
 // 	__u32 in_flight;
 // } __attribute__((preserve_access_index));
 
+/* 一轮结束时，用这一轮交付的包数/这一轮的时长得到一个速率样本，
+ * 再像Westwood一样用7/8的低通滤波平滑;
+ * 应用受限(tp->app_limited)的轮次速率偏低，不计入;
+ */
+static void elastic_update_bw(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct elastic *ca = inet_csk_ca(sk);
+	u32 interval = (u32)tp->tcp_mstamp - ca->round_start;
+	u64 sample;
+
+	if (tp->app_limited || (s32)interval <= 0)
+		return;
+
+	sample = div_u64((u64)(tp->delivered - ca->round_delivered) << BW_SCALE,
+			 interval);
+	sample = min_t(u64, sample, U32_MAX);
+	ca->bw = ca->bw ? (7 * (u64)ca->bw + sample) >> 3 : sample;
+}
+
+/* 丢包后的ssthresh：BDP = bw * baseRTT，限制在[cwnd*bdp_min_pct%, cwnd];
+ * 还没有速率或RTT样本时退回reno的减半;
+ */
+static u32 elastic_ssthresh(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	const struct elastic *ca = inet_csk_ca(sk);
+	u32 basertt = minmax_get(&ca->basertt);
+	u32 floor = max(tp->snd_cwnd * bdp_min_pct / 100, 2U);
+	u64 bdp;
+
+	if (!bdp_ssthresh || !ca->bw || basertt == 0x7fffffff)
+		return tcp_reno_ssthresh(sk);
+
+	bdp = ((u64)ca->bw * basertt) >> BW_SCALE;
+	return clamp_t(u64, bdp, floor, max(tp->snd_cwnd, floor));
+}
+
+/* elastic_dctcp的in_ack_event：每个ACK都会调用，不管有没有RTT样本;
+ * snd_una越过next_seq时一个窗口结束，用这个窗口里被CE标记的包数/交付的包数
+ * 更新alpha，和tcp_dctcp_update_alpha一样;
+ */
+static void elastic_dctcp_update_alpha(struct sock *sk, u32 flags)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	struct elastic *ca = inet_csk_ca(sk);
+
+	if (!before(tp->snd_una, ca->dctcp_next_seq)) {
+		u32 delivered = tp->delivered - ca->dctcp_old_delivered;
+		u32 delivered_ce = tp->delivered_ce - ca->dctcp_old_delivered_ce;
+		u32 shift_g = min(dctcp_shift_g, 10U);
+		u32 alpha = ca->dctcp_alpha;
+
+		alpha -= min_not_zero(alpha, alpha >> shift_g);
+		if (delivered_ce) {
+			delivered_ce <<= 10 - shift_g;
+			delivered_ce /= max(1U, delivered);
+			alpha = min(alpha + delivered_ce, DCTCP_MAX_ALPHA);
+		}
+		ca->dctcp_alpha = alpha;
+		ca->dctcp_next_seq = tp->snd_nxt;
+		ca->dctcp_old_delivered = tp->delivered;
+		ca->dctcp_old_delivered_ce = tp->delivered_ce;
+	}
+}
+
+/* 距上一个ACK interval us，确认了pkts个包：按交付速率发这些包至少要
+ * pkts/bw us，实际间隔比它的1/ack_agg_ratio还短就算聚合;
+ * 还没有速率估计时都不算;
+ */
+static bool elastic_ack_clumped(struct sock *sk, u32 interval, u32 pkts)
+{
+	const struct elastic *ca = inet_csk_ca(sk);
+
+	if (!ack_agg_ratio || !ca->bw)
+		return false;
+	return (u64)interval * ca->bw * ack_agg_ratio < (u64)pkts << BW_SCALE;
+}
+
+/* 以RTT轮数给出的窗口换算成us：轮数 * baseRTT;
+ * 还没有baseRTT样本时窗口很大，第一个样本总会进入滤波器;
+ */
+static u32 elastic_win_us(const struct elastic *ca, u32 rounds)
+{
+	return min_t(u64, (u64)rounds * minmax_get(&ca->basertt), S32_MAX);
+}
+
 static void elastic_rtt_calc(struct sock *sk, const struct ack_sample *sample)
 {
+	struct tcp_sock *tp = tcp_sk(sk);
 	struct elastic *ca = inet_csk_ca(sk);
+	u32 now = (u32)tp->tcp_mstamp;
+	u32 interval = now - ca->last_ack;
+	bool clumped;
 	u32 rtt;
 
+	//ACK簇和HyStart的ACK train都看和上一个ACK的间隔;
+
+	if ((s32)interval > hystart_ack_delta_us)
+		ca->in_train = 0;
+	ca->last_ack = now;
+
+	//这个ACK没有RTT样本(rtt_us<0)时不更新，否则0会钉住最小值;
+	if (sample->rtt_us < 0)
+		return;
+
+	/* 慢启动中速率每轮翻倍，按轮平滑的bw总是落后，几乎每个ACK都像簇，不做检测;
+	 * 簇也不跨轮：新一轮的第一个ACK总是开始新簇，maxRTT最多晚一轮拿到样本;
+	 */
+	clumped = !tcp_in_slow_start(tp) &&
+		  elastic_ack_clumped(sk, interval, sample->pkts_acked);
+
+	//snd_una越过上一轮开始时的snd_nxt，说明过了一个RTT;
+	if (after(tp->snd_una, ca->round_end)) {
+		elastic_update_bw(sk);
+		ca->round_end = tp->snd_nxt;
+		ca->round_delivered = tp->delivered;
+		elastic_hystart_reset(sk);
+		clumped = false;
+	}
+
 	// RTT不可能为0或者baseRTT;
 	rtt = sample->rtt_us + 1;
 
 	// baseRTT 传播时延，带宽充沛的最小RTT值;
-	if (rtt < ca->basertt)
-		ca->basertt = rtt;
-
-	//一个epoch实时RTT大于前面收集的最大RTT;
-	//调整收集的最大RTT;
-	if (rtt > ca->maxrtt || ca->maxrtt == 0)
-		ca->maxrtt = rtt;
+	//只看最近basertt_win_rounds轮，路由变化后能跟上新的传播时延;
+	minmax_running_min(&ca->basertt, elastic_win_us(ca, basertt_win_rounds),
+			   now, rtt);
 
+	/* 同一个ACK簇里只保留最小的RTT作为currtt;
+	 * 新的簇开始时，上一个簇的最小RTT才是无偏样本，这时再更新maxRTT;
+	 * 没有聚合时每个ACK自成一簇，maxRTT只晚一个ACK;
+	 */
+	if (clumped) {
+		ca->currtt = min(ca->currtt, rtt);
+	} else {
+		//一个epoch实时RTT大于前面收集的最大RTT;
+		//只看最近maxrtt_win_rounds轮，排队消失后maxRTT随之回落;
+		minmax_running_max(&ca->maxrtt, elastic_win_us(ca, maxrtt_win_rounds),
+				   now, ca->currtt);
+		ca->currtt = rtt;
+	}
 
-	ca->currtt = rtt;
-
+	//慢启动中用HyStart判断能否提前退出，避免超调两倍后大量丢包;
+	if (hystart && !ca->found && tcp_in_slow_start(tp) &&
+	    tp->snd_cwnd >= hystart_low_window)
+		elastic_hystart_update(sk, rtt);
 }
 
 static void tcp_elastic_event(struct sock *sk, enum tcp_ca_event event)
@@ -123,32 +607,453 @@ static void tcp_elastic_event(struct sock *sk, enum tcp_ca_event event)
 	//只有事件是丢包，overflow的状态，采集到的maxRTT应该是严重的，重置为0;
 	//后面再具体分析
 	case CA_EVENT_LOSS:
-		ca->maxrtt = 0;
+		minmax_reset(&ca->maxrtt, (u32)tcp_sk(sk)->tcp_mstamp, 0);
+		ca->loss_resets++;
+		//超时后重新慢启动，HyStart可以再次检测;
+		ca->found = 0;
 	default:
 		break;
 	}
 }
 
+/* elastic_dctcp的ECN拥塞响应：ssthresh = cwnd * (1 - alpha/2);
+ * 只有CE比例高的轮次才接近reno的减半，轻度标记只减一点;
+ */
+static u32 elastic_dctcp_ssthresh(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	const struct elastic *ca = inet_csk_ca(sk);
+
+	return max(tp->snd_cwnd - ((tp->snd_cwnd * ca->dctcp_alpha) >> 11U), 2U);
+}
+
+//真的丢包时不按CE比例减，和其它变体一样用BDP ssthresh，做法同tcp_dctcp;
+static void elastic_dctcp_state(struct sock *sk, u8 new_state)
+{
+	if (new_state == TCP_CA_Recovery &&
+	    new_state != inet_csk(sk)->icsk_ca_state)
+		tcp_sk(sk)->snd_ssthresh = elastic_ssthresh(sk);
+}
+
+static void elastic_dctcp_ece_ack_cwr(struct sock *sk, u32 ce_state)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (ce_state)
+		tp->ecn_flags |= TCP_ECN_DEMAND_CWR;
+	else
+		tp->ecn_flags &= ~TCP_ECN_DEMAND_CWR;
+}
+
+/* 接收端：ECE要逐包反映CE状态，而不是像RFC3168那样一直置位到收到CWR，
+ * 发送端才能数出被标记的比例;和tcp_dctcp的dctcp_ece_ack_update一样，
+ * CE状态变化时立即回ACK，如果有被延迟的ACK，先按旧状态把它发出去;
+ */
+static void elastic_dctcp_ece_update(struct sock *sk, u32 ce_state)
+{
+	struct elastic *ca = inet_csk_ca(sk);
+
+	if (ca->ce_state != ce_state) {
+		if (inet_csk(sk)->icsk_ack.pending & ICSK_ACK_TIMER) {
+			elastic_dctcp_ece_ack_cwr(sk, ca->ce_state);
+			__tcp_send_ack(sk, ca->dctcp_prior_rcv_nxt);
+		}
+		inet_csk(sk)->icsk_ack.pending |= ICSK_ACK_NOW;
+	}
+	ca->dctcp_prior_rcv_nxt = tcp_sk(sk)->rcv_nxt;
+	ca->ce_state = ce_state;
+	elastic_dctcp_ece_ack_cwr(sk, ce_state);
+}
+
+static void elastic_dctcp_event(struct sock *sk, enum tcp_ca_event event)
+{
+	switch (event) {
+	case CA_EVENT_ECN_IS_CE:
+	case CA_EVENT_ECN_NO_CE:
+		elastic_dctcp_ece_update(sk, event == CA_EVENT_ECN_IS_CE);
+		break;
+	//RTO：tcp_enter_loss已经用elastic_dctcp_ssthresh设过，换成BDP ssthresh;
+	case CA_EVENT_LOSS:
+		tcp_sk(sk)->snd_ssthresh = elastic_ssthresh(sk);
+		tcp_elastic_event(sk, event);
+		break;
+	default:
+		tcp_elastic_event(sk, event);
+		break;
+	}
+}
+
+//socket所用变体的增长规律算出的当前gap，固定规律的变体不看growth参数;
+static u32 elastic_info_gap(struct sock *sk)
+{
+	const struct tcp_congestion_ops *ops = inet_csk(sk)->icsk_ca_ops;
+	const struct elastic *ca = inet_csk_ca(sk);
+	u32 cwnd = tcp_sk(sk)->snd_cwnd;
+	u32 maxrtt = minmax_get(&ca->maxrtt);
+
+	if (ops->cong_avoid == elastic_sqrt_cong_avoid)
+		return elastic_gap_sqrt(cwnd, maxrtt, ca->currtt);
+	if (ops->cong_avoid == elastic_log_cong_avoid)
+		return elastic_gap_log(cwnd, maxrtt, ca->currtt);
+	if (ops->cong_avoid == elastic_linear_cong_avoid)
+		return elastic_gap_linear(cwnd, maxrtt, ca->currtt);
+	return elastic_gap(cwnd, maxrtt, ca->currtt);
+}
+
+static size_t tcp_elastic_info(struct sock *sk, u32 ext, int *attr,
+			       union tcp_cc_info *info)
+{
+	const struct elastic *ca = inet_csk_ca(sk);
+	struct tcp_elastic_info *ei = (struct tcp_elastic_info *)info;
+
+	if (ext & (1 << (INET_DIAG_VEGASINFO - 1))) {
+		ei->elastic_maxrtt = minmax_get(&ca->maxrtt);
+		ei->elastic_loss_resets = ca->loss_resets;
+		ei->elastic_currtt = ca->currtt;
+		ei->elastic_basertt = minmax_get(&ca->basertt);
+		ei->elastic_gap = elastic_info_gap(sk);
+
+		*attr = INET_DIAG_VEGASINFO;
+		return sizeof(struct tcp_elastic_info);
+	}
+	return 0;
+}
+
+/* 按cwnd和RTT设置发送速率，和内核tcp_update_pacing_rate的算法一样，
+ * 只是增益和RTT的选择用本模块的参数;
+ * 还没有RTT样本时保留当前速率;
+ */
+static void elastic_set_pacing_rate(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct elastic *ca = inet_csk_ca(sk);
+	u32 rtt = pacing_rtt ? ca->currtt : tp->srtt_us >> 3;
+	u32 gain = tcp_in_slow_start(tp) ? pacing_ss_gain : pacing_ca_gain;
+	u64 rate;
+
+	if (!rtt)
+		return;
+
+	rate = (u64)tp->mss_cache * USEC_PER_SEC / 100 * gain;
+	rate *= max(tp->snd_cwnd, tp->packets_out);
+	rate = div_u64(rate, rtt);
+	WRITE_ONCE(sk->sk_pacing_rate,
+		   min_t(u64, rate, READ_ONCE(sk->sk_max_pacing_rate)));
+}
+
+static void elastic_pacing_init(struct sock *sk)
+{
+	elastic_init(sk);
+	//不依赖fq，由TCP自己按sk_pacing_rate调度发送;
+	cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
+	elastic_set_pacing_rate(sk);
+}
+
+/* CWR/Recovery期间的cwnd，和内核tcp_cwnd_reduction的PRR(RFC 6937)一样:
+ * 在途包数高于ssthresh时按ssthresh/prior_cwnd的比例发送，低于时逐步补回ssthresh;
+ * snd_una前移且这个ACK没有发现新丢包时多发一个包;
+ * prior_cwnd、prr_out由内核在进入CWR/Recovery和发包时维护;
+ */
+static void elastic_cwnd_reduction(struct sock *sk, const struct rate_sample *rs,
+				   bool una_advanced)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	int delta = tp->snd_ssthresh - tcp_packets_in_flight(tp);
+	int sndcnt;
+
+	if (!rs->acked_sacked || !tp->prior_cwnd)
+		return;
+
+	tp->prr_delivered += rs->acked_sacked;
+	if (delta < 0) {
+		u64 dividend = (u64)tp->snd_ssthresh * tp->prr_delivered +
+			       tp->prior_cwnd - 1;
+
+		sndcnt = div_u64(dividend, tp->prior_cwnd) - tp->prr_out;
+	} else {
+		sndcnt = max_t(int, tp->prr_delivered - tp->prr_out,
+			       rs->acked_sacked);
+		if (una_advanced && rs->losses <= 0)
+			sndcnt++;
+		sndcnt = min(delta, sndcnt);
+	}
+	//刚进入快速恢复时至少能发出快速重传;
+	sndcnt = max(sndcnt, tp->prr_out ? 0 : 1);
+	tp->snd_cwnd = tcp_packets_in_flight(tp) + sndcnt;
+}
+
+/* 和内核tcp_may_raise_cwnd一样：重排序不严重时只在累计确认前移时增窗(RFC 5681)，
+ * 重排序严重时有新确认或新SACK就增窗;
+ */
+static bool elastic_may_raise_cwnd(struct sock *sk, const struct rate_sample *rs,
+				   bool una_advanced)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+
+	if (tp->reordering > READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_reordering))
+		return rs->acked_sacked;
+	return una_advanced;
+}
+
+/* cong_control取代了内核的tcp_cong_control，所以要自己做它的判断:
+ * CWR/Recovery期间按PRR减窗，其余状态只有允许增窗并且cwnd受限时才走
+ * elastic_cong_avoid，最后按新的cwnd更新发送速率;
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+static void elastic_cong_control(struct sock *sk, u32 ack, int flag,
+				 const struct rate_sample *rs)
+#else
+static void elastic_cong_control(struct sock *sk, const struct rate_sample *rs)
+#endif
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct elastic *ca = inet_csk_ca(sk);
+	bool una_advanced = after(tp->snd_una, ca->last_snd_una);
+
+	if (tcp_in_cwnd_reduction(sk))
+		elastic_cwnd_reduction(sk, rs, una_advanced);
+	else if (elastic_may_raise_cwnd(sk, rs, una_advanced) &&
+		 tcp_is_cwnd_limited(sk))
+		elastic_cong_avoid(sk, 0, rs->acked_sacked);
+	ca->last_snd_una = tp->snd_una;
+	elastic_set_pacing_rate(sk);
+}
+
 static struct tcp_congestion_ops tcp_elastic __read_mostly = {
 	.init		= elastic_init,
-	.ssthresh	= tcp_reno_ssthresh,
+	.ssthresh	= elastic_ssthresh,
 	.undo_cwnd	= tcp_reno_undo_cwnd,
 	.cong_avoid	= elastic_cong_avoid,
 	.pkts_acked	= elastic_rtt_calc,
 	.cwnd_event	= tcp_elastic_event,
+	.get_info	= tcp_elastic_info,
 	.owner		= THIS_MODULE,
 	.name		= "elastic"
 };
 
+//同样的增长规律，加上自己计算的pacing，用setsockopt(TCP_CONGESTION)按名字选择;
+static struct tcp_congestion_ops tcp_elastic_pacing __read_mostly = {
+	.init		= elastic_pacing_init,
+	.ssthresh	= elastic_ssthresh,
+	.undo_cwnd	= tcp_reno_undo_cwnd,
+	.cong_avoid	= elastic_cong_avoid,
+	.cong_control	= elastic_cong_control,
+	.pkts_acked	= elastic_rtt_calc,
+	.cwnd_event	= tcp_elastic_event,
+	.get_info	= tcp_elastic_info,
+	.owner		= THIS_MODULE,
+	.name		= "elastic_pacing"
+};
+
+//固定增长规律的变体，不受growth参数影响，用来在同一台机器上做A/B对比;
+static struct tcp_congestion_ops tcp_elastic_sqrt __read_mostly = {
+	.init		= elastic_init,
+	.ssthresh	= elastic_ssthresh,
+	.undo_cwnd	= tcp_reno_undo_cwnd,
+	.cong_avoid	= elastic_sqrt_cong_avoid,
+	.pkts_acked	= elastic_rtt_calc,
+	.cwnd_event	= tcp_elastic_event,
+	.get_info	= tcp_elastic_info,
+	.owner		= THIS_MODULE,
+	.name		= "elastic_sqrt"
+};
+
+static struct tcp_congestion_ops tcp_elastic_log __read_mostly = {
+	.init		= elastic_init,
+	.ssthresh	= elastic_ssthresh,
+	.undo_cwnd	= tcp_reno_undo_cwnd,
+	.cong_avoid	= elastic_log_cong_avoid,
+	.pkts_acked	= elastic_rtt_calc,
+	.cwnd_event	= tcp_elastic_event,
+	.get_info	= tcp_elastic_info,
+	.owner		= THIS_MODULE,
+	.name		= "elastic_log"
+};
+
+static struct tcp_congestion_ops tcp_elastic_linear __read_mostly = {
+	.init		= elastic_init,
+	.ssthresh	= elastic_ssthresh,
+	.undo_cwnd	= tcp_reno_undo_cwnd,
+	.cong_avoid	= elastic_linear_cong_avoid,
+	.pkts_acked	= elastic_rtt_calc,
+	.cwnd_event	= tcp_elastic_event,
+	.get_info	= tcp_elastic_info,
+	.owner		= THIS_MODULE,
+	.name		= "elastic_linear"
+};
+
+/* 对端没有协商ECN时，和tcp_dctcp一样退回普通的elastic，
+ * 并清掉握手时为ECN设置的ECT;
+ */
+static void elastic_dctcp_init(struct sock *sk)
+{
+	elastic_init(sk);
+	if (!(tcp_sk(sk)->ecn_flags & TCP_ECN_OK) &&
+	    sk->sk_state != TCP_LISTEN && sk->sk_state != TCP_CLOSE) {
+		inet_csk(sk)->icsk_ca_ops = &tcp_elastic;
+		INET_ECN_dontxmit(sk);
+	}
+}
+
+//数据中心模式，协商ECN(不依赖net.ipv4.tcp_ecn)，按CE比例减窗;
+static struct tcp_congestion_ops tcp_elastic_dctcp __read_mostly = {
+	.init		= elastic_dctcp_init,
+	.ssthresh	= elastic_dctcp_ssthresh,
+	.undo_cwnd	= tcp_reno_undo_cwnd,
+	.cong_avoid	= elastic_cong_avoid,
+	.set_state	= elastic_dctcp_state,
+	.in_ack_event	= elastic_dctcp_update_alpha,
+	.pkts_acked	= elastic_rtt_calc,
+	.cwnd_event	= elastic_dctcp_event,
+	.get_info	= tcp_elastic_info,
+	.flags		= TCP_CONG_NEEDS_ECN,
+	.owner		= THIS_MODULE,
+	.name		= "elastic_dctcp"
+};
+
+static struct tcp_congestion_ops *elastic_ops[] = {
+	&tcp_elastic,
+	&tcp_elastic_pacing,
+	&tcp_elastic_sqrt,
+	&tcp_elastic_log,
+	&tcp_elastic_linear,
+	&tcp_elastic_dctcp,
+};
+
+#ifdef TCP_ELASTIC_BENCH
+//|product-pow|：原来对无符号的差取abs，pow比product大时得到的是回绕后的大数;
+static unsigned long int_logarithm_err(unsigned long product, unsigned long pow)
+{
+	return product > pow ? product - pow : pow - product;
+}
+
+//原来逐个试探指数的整数对数，现在只作为基准测试里的对照;
+static unsigned long int_logarithm(unsigned long base,unsigned long product){
+	//这里只要整型
+	unsigned int current_pow=1;
+	//找到最靠近的整型数
+	bool closest_int=false;
+	//误差值
+	unsigned long current_err=0;
+
+	//非法的值
+	if(base<=1||product==0)
+		return 0;
+	//正常值,但是是特殊点
+	if(1==product)
+		return 0;
+	if(base==product)
+		return 1;
+	//合法值，逼近计算
+	while(!closest_int){
+		current_err=int_logarithm_err(product,int_pow(base,current_pow));
+		//比大的值近
+		if(current_err>int_logarithm_err(product,int_pow(base,current_pow+1)))
+			current_pow+=1;
+		//比小的值近
+		else if(current_err>int_logarithm_err(product,int_pow(base,current_pow-1)))
+			current_pow-=1;
+		//锁定
+		else
+			closest_int =true;
+	}
+
+	return current_pow;
+}
+
+/* 增长计算的基准测试：旧的32位int_sqrt、int_logarithm路径和定点sqrt、log路径
+ * 各跑bench次，打印每次调用的周期数，sqrt路径相对int_sqrt64精确值的误差(万分之一)，
+ * 以及两种log的结果(定点的按整数.百分位打印);
+ * 旧路径在cwnd*maxrtt超过4G后溢出，误差一栏同时打印它;
+ * 输入随i变化，避免计算被提到循环外;
+ */
+#define ELASTIC_BENCH(expr)						\
+	({								\
+		cycles_t __start = get_cycles();			\
+		u32 i;							\
+									\
+		for (i = 0; i < bench; i++) {				\
+			u32 w = cwnd + (i & 15);			\
+									\
+			OPTIMIZER_HIDE_VAR(w);				\
+			sink += (expr);					\
+		}							\
+		div_u64(get_cycles() - __start, bench);			\
+	})
+
+static void elastic_bench(void)
+{
+	static const u32 cases[][3] = {
+		/* cwnd, maxrtt(us), currtt(us) */
+		{ 10, 1000, 800 },
+		{ 100, 20000, 15000 },
+		{ 1000, 50000, 20000 },
+		{ 2000, 3000, 2000 },
+		{ 10000, 100000, 50000 },
+		{ 100000, 300000, 100000 },
+	};
+	int c;
+
+	for (c = 0; c < ARRAY_SIZE(cases); c++) {
+		u32 cwnd = cases[c][0], maxrtt = cases[c][1], currtt = cases[c][2];
+		u64 exact = int_sqrt64(div64_u64((u64)cwnd * maxrtt << 16, currtt));
+		u64 old_cycles, sqrt_cycles, old_log_cycles, log_cycles;
+		u32 old_err = 0, new_err = 0;
+		u32 old_log = int_logarithm(2, cwnd * maxrtt / currtt);
+		u32 new_log = elastic_gap_log(cwnd, maxrtt, currtt);
+		u64 sink = 0;
+
+		old_cycles = ELASTIC_BENCH(int_sqrt(w * maxrtt / currtt));
+		sqrt_cycles = ELASTIC_BENCH(elastic_gap_sqrt(w, maxrtt, currtt));
+		old_log_cycles = ELASTIC_BENCH(int_logarithm(2, w * maxrtt / currtt));
+		log_cycles = ELASTIC_BENCH(elastic_gap_log(w, maxrtt, currtt));
+
+		if (exact) {
+			u64 prev = (u64)int_sqrt(cwnd * maxrtt / currtt) << ELASTIC_FRAC_BITS;
+			u64 fixed = elastic_gap_sqrt(cwnd, maxrtt, currtt);
+
+			old_err = div64_u64((prev > exact ? prev - exact : exact - prev) * 10000, exact);
+			new_err = div64_u64((fixed > exact ? fixed - exact : exact - fixed) * 10000, exact);
+		}
+		pr_info("elastic bench: cwnd %u maxrtt %u currtt %u: int_sqrt %llu cycles err %u/10000, fixed-point sqrt %llu cycles err %u/10000, int_logarithm %llu cycles = %u, fixed-point log %llu cycles = %u.%02u (%llu)\n",
+			cwnd, maxrtt, currtt, old_cycles, old_err,
+			sqrt_cycles, new_err, old_log_cycles, old_log,
+			log_cycles, new_log >> ELASTIC_FRAC_BITS,
+			((new_log & ((1 << ELASTIC_FRAC_BITS) - 1)) * 100) >> ELASTIC_FRAC_BITS,
+			sink);
+	}
+}
+#endif
+
 static int __init elastic_register(void)
 {
+	int i, ret;
+
 	BUILD_BUG_ON(sizeof(struct elastic) > ICSK_CA_PRIV_SIZE);
-	return tcp_register_congestion_control(&tcp_elastic);
+	BUILD_BUG_ON(sizeof(struct tcp_elastic_info) > sizeof(union tcp_cc_info));
+#ifdef TCP_ELASTIC_BENCH
+	if (bench)
+		elastic_bench();
+#endif
+	for (i = 0; i < ARRAY_SIZE(elastic_ops); i++) {
+		ret = tcp_register_congestion_control(elastic_ops[i]);
+		if (ret)
+			goto unregister;
+	}
+	return 0;
+
+unregister:
+	while (--i >= 0)
+		tcp_unregister_congestion_control(elastic_ops[i]);
+	return ret;
 }
 
 static void __exit elastic_unregister(void)
 {
-	tcp_unregister_congestion_control(&tcp_elastic);
+	int i;
+
+	for (i = ARRAY_SIZE(elastic_ops) - 1; i >= 0; i--)
+		tcp_unregister_congestion_control(elastic_ops[i]);
 }
 
 module_init(elastic_register);
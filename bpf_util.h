@@ -0,0 +1,204 @@
+#ifndef BPF_UTIL_H
+#define BPF_UTIL_H
+
+// Minimal eBPF plumbing on top of the raw bpf(2) syscall, so the XDP modes of
+// udpreceiver need neither libbpf nor clang. Programs are assembled at runtime
+// with the instruction builders below.
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+static inline long sys_bpf(int cmd, union bpf_attr *attr) {
+  return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static inline struct bpf_insn bpf_make_insn(uint8_t code, uint8_t dst,
+                                            uint8_t src, int16_t off,
+                                            int32_t imm) {
+  struct bpf_insn insn;
+  insn.code = code;
+  insn.dst_reg = dst;
+  insn.src_reg = src;
+  insn.off = off;
+  insn.imm = imm;
+  return insn;
+}
+
+// Same names and operand order as the kernel's include/linux/filter.h.
+#define BPF_MOV64_REG(dst, src) \
+  bpf_make_insn(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0)
+#define BPF_MOV64_IMM(dst, imm) \
+  bpf_make_insn(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm)
+#define BPF_ALU64_REG(op, dst, src) \
+  bpf_make_insn(BPF_ALU64 | BPF_OP(op) | BPF_X, dst, src, 0, 0)
+#define BPF_ALU64_IMM(op, dst, imm) \
+  bpf_make_insn(BPF_ALU64 | BPF_OP(op) | BPF_K, dst, 0, 0, imm)
+#define BPF_LDX_MEM(size, dst, src, off) \
+  bpf_make_insn(BPF_LDX | BPF_SIZE(size) | BPF_MEM, dst, src, off, 0)
+#define BPF_STX_MEM(size, dst, src, off) \
+  bpf_make_insn(BPF_STX | BPF_SIZE(size) | BPF_MEM, dst, src, off, 0)
+#define BPF_ST_MEM(size, dst, off, imm) \
+  bpf_make_insn(BPF_ST | BPF_SIZE(size) | BPF_MEM, dst, 0, off, imm)
+#define BPF_JMP_REG(op, dst, src, off) \
+  bpf_make_insn(BPF_JMP | BPF_OP(op) | BPF_X, dst, src, off, 0)
+#define BPF_JMP_IMM(op, dst, imm, off) \
+  bpf_make_insn(BPF_JMP | BPF_OP(op) | BPF_K, dst, 0, off, imm)
+#define BPF_ATOMIC_OP(size, op, dst, src, off) \
+  bpf_make_insn(BPF_STX | BPF_SIZE(size) | BPF_ATOMIC, dst, src, off, op)
+#define BPF_ENDIAN(type, dst, len) \
+  bpf_make_insn(BPF_ALU | BPF_END | (type), dst, 0, 0, len)
+#define BPF_EMIT_CALL(func) bpf_make_insn(BPF_JMP | BPF_CALL, 0, 0, 0, func)
+#define BPF_EXIT_INSN() bpf_make_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+// A program under construction plus the jumps still waiting for a target.
+struct bpf_prog_builder {
+  std::vector<struct bpf_insn> insns;
+  std::vector<size_t> fixups;
+};
+
+static inline void bpf_emit(struct bpf_prog_builder *b, struct bpf_insn insn) {
+  b->insns.push_back(insn);
+}
+
+// Emit a conditional jump whose target is set by the next bpf_resolve().
+static inline void bpf_emit_fixup(struct bpf_prog_builder *b,
+                                  struct bpf_insn insn) {
+  b->fixups.push_back(b->insns.size());
+  b->insns.push_back(insn);
+}
+
+// Point every pending jump at the next instruction to be emitted.
+static inline void bpf_resolve(struct bpf_prog_builder *b) {
+  for (size_t at : b->fixups) {
+    b->insns[at].off = (int16_t)(b->insns.size() - at - 1);
+  }
+  b->fixups.clear();
+}
+
+// Load a map reference; the verifier rewrites the fd into a map pointer.
+static inline void bpf_emit_ld_map_fd(struct bpf_prog_builder *b, int reg,
+                                      int fd) {
+  bpf_emit(b, bpf_make_insn(BPF_LD | BPF_DW | BPF_IMM, reg,
+                            BPF_PSEUDO_MAP_FD, 0, fd));
+  bpf_emit(b, bpf_make_insn(0, 0, 0, 0, 0));
+}
+
+// XDP prologue: leaves ctx in r6, data in r2 and data_end in r3, and falls
+// through only for unfragmented IPv4 (no options) UDP to the given port. All
+// other frames jump to the pending fixup target.
+static inline void bpf_emit_xdp_udp_match(struct bpf_prog_builder *b,
+                                          uint16_t port) {
+  const int l4 = ETH_HLEN + 20;
+
+  bpf_emit(b, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+  bpf_emit(b, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6,
+                          offsetof(struct xdp_md, data)));
+  bpf_emit(b, BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_6,
+                          offsetof(struct xdp_md, data_end)));
+  bpf_emit(b, BPF_MOV64_REG(BPF_REG_4, BPF_REG_2));
+  bpf_emit(b, BPF_ALU64_IMM(BPF_ADD, BPF_REG_4, l4 + 8));
+  bpf_emit_fixup(b, BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 0));
+  // Loads are in host order, so compare against network-order constants.
+  bpf_emit(b, BPF_LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, 12));
+  bpf_emit_fixup(b, BPF_JMP_IMM(BPF_JNE, BPF_REG_5, htons(ETH_P_IP), 0));
+  bpf_emit(b, BPF_LDX_MEM(BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN));
+  bpf_emit_fixup(b, BPF_JMP_IMM(BPF_JNE, BPF_REG_5, 0x45, 0));
+  bpf_emit(b, BPF_LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, ETH_HLEN + 6));
+  bpf_emit(b, BPF_ALU64_IMM(BPF_AND, BPF_REG_5, htons(0x3fff)));
+  bpf_emit_fixup(b, BPF_JMP_IMM(BPF_JNE, BPF_REG_5, 0, 0));
+  bpf_emit(b, BPF_LDX_MEM(BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN + 9));
+  bpf_emit_fixup(b, BPF_JMP_IMM(BPF_JNE, BPF_REG_5, IPPROTO_UDP, 0));
+  bpf_emit(b, BPF_LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, l4 + 2));
+  bpf_emit_fixup(b, BPF_JMP_IMM(BPF_JNE, BPF_REG_5, htons(port), 0));
+}
+
+static inline int bpf_map_create(enum bpf_map_type type, uint32_t key_size,
+                                 uint32_t value_size, uint32_t max_entries) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = type;
+  attr.key_size = key_size;
+  attr.value_size = value_size;
+  attr.max_entries = max_entries;
+  return (int)sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static inline int bpf_map_update(int fd, const void *key, const void *value) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = fd;
+  attr.key = (uint64_t)(uintptr_t)key;
+  attr.value = (uint64_t)(uintptr_t)value;
+  attr.flags = BPF_ANY;
+  return (int)sys_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+static inline int bpf_map_lookup(int fd, const void *key, void *value) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = fd;
+  attr.key = (uint64_t)(uintptr_t)key;
+  attr.value = (uint64_t)(uintptr_t)value;
+  return (int)sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr);
+}
+
+// Per-CPU maps return one value per possible CPU, not per online CPU.
+static inline int bpf_num_possible_cpus() {
+  FILE *f = fopen("/sys/devices/system/cpu/possible", "r");
+  int first = 0, last = 0;
+  if (f == NULL) {
+    return -1;
+  }
+  int n = fscanf(f, "%d-%d", &first, &last);
+  fclose(f);
+  if (n < 1) {
+    return -1;
+  }
+  return (n == 1 ? first : last) + 1;
+}
+
+// Load a program, printing the verifier log if it is rejected.
+static inline int bpf_prog_load(enum bpf_prog_type type,
+                                const struct bpf_prog_builder *b) {
+  static char log[65536];
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = type;
+  attr.insns = (uint64_t)(uintptr_t)b->insns.data();
+  attr.insn_cnt = (uint32_t)b->insns.size();
+  attr.license = (uint64_t)(uintptr_t)"GPL";
+  attr.log_buf = (uint64_t)(uintptr_t)log;
+  attr.log_size = sizeof(log);
+  attr.log_level = 1;
+  log[0] = '\0';
+
+  int fd = (int)sys_bpf(BPF_PROG_LOAD, &attr);
+  if (fd < 0) {
+    perror("bpf(BPF_PROG_LOAD)");
+    fprintf(stderr, "%s\n", log);
+  }
+  return fd;
+}
+
+// Attach an XDP program through a BPF link, which detaches automatically when
+// the returned fd is closed or the process exits.
+static inline int bpf_xdp_attach(int ifindex, int prog_fd, uint32_t flags) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd = prog_fd;
+  attr.link_create.target_ifindex = ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = flags;
+  return (int)sys_bpf(BPF_LINK_CREATE, &attr);
+}
+
+#endif
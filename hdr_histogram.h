@@ -0,0 +1,93 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Log-linear (HDR style) histogram of nanosecond values. Every power-of-two
+// range is split into HDR_SUB_BUCKETS/2 linear slots, so any recorded value is
+// reported with a relative error below 2^-(HDR_SUB_BITS-1) (~0.2%).
+#define HDR_SUB_BITS 10
+#define HDR_SUB_BUCKETS (1 << HDR_SUB_BITS)
+#define HDR_HALF_BUCKETS (HDR_SUB_BUCKETS / 2)
+// Values are clamped to 2^HDR_MAX_BITS - 1 ns (~18 minutes).
+#define HDR_MAX_BITS 40
+#define HDR_COUNTS \
+  (HDR_SUB_BUCKETS + (HDR_MAX_BITS - HDR_SUB_BITS) * HDR_HALF_BUCKETS)
+
+struct hdr_histogram {
+  uint64_t total;
+  uint64_t max;
+  uint64_t counts[HDR_COUNTS];
+};
+
+static inline void hdr_reset(struct hdr_histogram *h) {
+  memset(h, 0, sizeof(*h));
+}
+
+static inline int hdr_index(uint64_t value) {
+  if (value < HDR_SUB_BUCKETS) {
+    return (int)value;
+  }
+  if (value >> HDR_MAX_BITS) {
+    value = (1ULL << HDR_MAX_BITS) - 1;
+  }
+  // Shift so that the top HDR_SUB_BITS bits land in [HALF, SUB).
+  int shift = 63 - __builtin_clzll(value) - (HDR_SUB_BITS - 1);
+  return HDR_SUB_BUCKETS + (shift - 1) * HDR_HALF_BUCKETS +
+         (int)(value >> shift) - HDR_HALF_BUCKETS;
+}
+
+// Largest value that maps to the same slot as index.
+static inline uint64_t hdr_highest_equivalent(int index) {
+  if (index < HDR_SUB_BUCKETS) {
+    return (uint64_t)index;
+  }
+  int shift = (index - HDR_SUB_BUCKETS) / HDR_HALF_BUCKETS + 1;
+  uint64_t mantissa =
+      (uint64_t)((index - HDR_SUB_BUCKETS) % HDR_HALF_BUCKETS) +
+      HDR_HALF_BUCKETS;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+static inline void hdr_record(struct hdr_histogram *h, uint64_t value) {
+  h->counts[hdr_index(value)]++;
+  h->total++;
+  if (value > h->max) {
+    h->max = value;
+  }
+}
+
+static inline void hdr_merge(struct hdr_histogram *dst,
+                             const struct hdr_histogram *src) {
+  for (int i = 0; i < HDR_COUNTS; i++) {
+    dst->counts[i] += src->counts[i];
+  }
+  dst->total += src->total;
+  if (src->max > dst->max) {
+    dst->max = src->max;
+  }
+}
+
+// Value at the given percentile (0-100], or 0 for an empty histogram.
+static inline uint64_t hdr_percentile(const struct hdr_histogram *h,
+                                      double percentile) {
+  if (h->total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->total + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < HDR_COUNTS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t value = hdr_highest_equivalent(i);
+      return value < h->max ? value : h->max;
+    }
+  }
+  return h->max;
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef RUN_CONTROL_H
+#define RUN_CONTROL_H
+
+// Benchmark run controller shared by udpsender and udpreceiver: summary
+// statistics over repetitions and the line-based control connection through
+// which the sender opens and closes measurement windows on the receiver.
+//
+// Control protocol, one text line per message, sender to receiver:
+//   START <rep>   a measurement window begins now
+//   STOP <rep>    it ends; answered with RESULT <rep> <packets> <bytes> <ns>
+//   DONE          the run is over, the receiver exits
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#define CONTROL_LINE_MAX 256
+
+// Two-sided 95% Student t quantiles for 1..30 degrees of freedom.
+static const double run_t95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+struct run_summary {
+  double mean;
+  double stddev;
+  // Half width of the 95% confidence interval of the mean.
+  double ci95;
+};
+
+static inline struct run_summary run_summarize(const std::vector<double> &v) {
+  struct run_summary s = {0, 0, 0};
+  size_t n = v.size();
+
+  if (n == 0) {
+    return s;
+  }
+  for (double x : v) {
+    s.mean += x;
+  }
+  s.mean /= n;
+  if (n < 2) {
+    return s;
+  }
+  for (double x : v) {
+    s.stddev += (x - s.mean) * (x - s.mean);
+  }
+  s.stddev = sqrt(s.stddev / (n - 1));
+  double t = n - 1 <= 30 ? run_t95[n - 2] : 1.960;
+  s.ci95 = t * s.stddev / sqrt((double)n);
+  return s;
+}
+
+// One column of per-repetition results, e.g. "tx_pps".
+struct run_series {
+  const char *name;
+  std::vector<double> values;
+};
+
+// Per-repetition table followed by mean, stddev and 95% CI rows.
+static inline void run_report(FILE *out, const char *header,
+                              const std::vector<struct run_series> &series) {
+  fprintf(out, "# %s\n%-8s", header, "rep");
+  for (const auto &s : series) {
+    fprintf(out, " %16s", s.name);
+  }
+  fprintf(out, "\n");
+  size_t reps = series.empty() ? 0 : series[0].values.size();
+  for (size_t r = 0; r < reps; r++) {
+    fprintf(out, "%-8zu", r + 1);
+    for (const auto &s : series) {
+      fprintf(out, " %16.0f", s.values[r]);
+    }
+    fprintf(out, "\n");
+  }
+  std::vector<struct run_summary> sums;
+  for (const auto &s : series) {
+    sums.push_back(run_summarize(s.values));
+  }
+  fprintf(out, "%-8s", "mean");
+  for (const auto &s : sums) {
+    fprintf(out, " %16.0f", s.mean);
+  }
+  fprintf(out, "\n%-8s", "stddev");
+  for (const auto &s : sums) {
+    fprintf(out, " %16.0f", s.stddev);
+  }
+  fprintf(out, "\n%-8s", "ci95");
+  for (const auto &s : sums) {
+    fprintf(out, " %16.0f", s.ci95);
+  }
+  fprintf(out, "\n");
+}
+
+static inline int control_listen(uint16_t port) {
+  struct sockaddr_in addr;
+  int one = 1;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (fd < 0) {
+    perror("control socket");
+    return -1;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fd, 1) < 0) {
+    perror("control bind");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Connect to "ip:port". Windows are opened and closed by single small
+// writes, so Nagle is turned off to keep them on time.
+static inline int control_connect(const std::string &target) {
+  struct sockaddr_in addr;
+  int one = 1;
+  size_t colon = target.find(':');
+
+  if (colon == std::string::npos) {
+    fprintf(stderr, "control address must be ip:port\n");
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(std::stoi(target.substr(colon + 1)));
+  addr.sin_addr.s_addr = inet_addr(target.substr(0, colon).c_str());
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("control socket");
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("control connect");
+    close(fd);
+    return -1;
+  }
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+static inline int control_send(int fd, const char *fmt, ...) {
+  char line[CONTROL_LINE_MAX];
+  va_list ap;
+
+  va_start(ap, fmt);
+  int len = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (len < 0 || len >= (int)sizeof(line)) {
+    return -1;
+  }
+  return send(fd, line, len, MSG_NOSIGNAL) == len ? 0 : -1;
+}
+
+// Read one '\n' terminated line (without the newline). Control traffic is a
+// handful of lines per run, so byte-at-a-time reads are fine.
+static inline int control_recv_line(int fd, char *line, size_t size) {
+  size_t len = 0;
+
+  while (len + 1 < size) {
+    char c;
+    ssize_t n = recv(fd, &c, 1, 0);
+    if (n <= 0) {
+      return -1;
+    }
+    if (c == '\n') {
+      break;
+    }
+    line[len++] = c;
+  }
+  line[len] = '\0';
+  return (int)len;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Loopback check of udpreceiver --reflect combined with the options that make
+# recvmmsg collect cmsgs. Each combination must keep reflecting for the whole
+# run: the receiver stays alive and counts the sender's ping-pong traffic.
+#
+#   tests/loopback_reflect.sh [BUILD_DIR]
+
+set -u
+cd "$(dirname "$0")/.."
+out=${1:-$(mktemp -d)}
+port=12233
+status=0
+
+g++ -O2 -pthread udpsender.cc -o "$out/udpsender" || exit 1
+g++ -O2 -pthread udpreceiver.cc -o "$out/udpreceiver" || exit 1
+
+for opts in "--rx-latency" "--drops" "--rx-latency --drops"; do
+  log="$out/receiver.log"
+  "$out/udpreceiver" --reflect $opts >"$log" 2>&1 &
+  receiver=$!
+  sleep 0.5
+  timeout 3 "$out/udpsender" --latency "127.0.0.1:$port" >/dev/null 2>&1
+  # Output is block buffered into the log, so look at it once stopped.
+  kill -0 "$receiver" 2>/dev/null
+  alive=$?
+  kill "$receiver" 2>/dev/null
+  wait "$receiver" 2>/dev/null
+  if [ $alive -eq 0 ] && grep -q '^packets=[1-9]' "$log"; then
+    echo "ok   --reflect $opts"
+  else
+    echo "FAIL --reflect $opts"
+    cat "$log"
+    status=1
+  fi
+done
+exit $status
@@ -0,0 +1,197 @@
+#ifndef TSC_CLOCK_H
+#define TSC_CLOCK_H
+
+// Cheap timestamps for hot loops. tsc_ticks() reads the invariant TSC, which
+// is calibrated against CLOCK_MONOTONIC once at startup; ticks are converted
+// to nanoseconds only when reporting. Where the TSC cannot be trusted (not
+// invariant, or not the kernel's clocksource) ticks are plain CLOCK_MONOTONIC
+// nanoseconds from the vDSO, and the conversions become identities. That is
+// also the only clock off x86.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TSC_CLOCK_X86 1
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#define TSC_CALIBRATE_MS 50
+#define TSC_FRAC_BITS 32
+
+struct tsc_clock {
+  bool tsc;
+  // ns = ticks * ns_mult >> TSC_FRAC_BITS, and the other way round.
+  uint64_t ns_mult;
+  uint64_t tick_mult;
+  uint64_t tick_base;
+  uint64_t mono_base;
+  int64_t realtime_offset;
+};
+
+static struct tsc_clock tsc_clock = {false, 1ULL << TSC_FRAC_BITS,
+                                     1ULL << TSC_FRAC_BITS, 0, 0, 0};
+
+static inline uint64_t tsc_clock_ns(clockid_t id) {
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Raw counter read. Not serializing: the read may move by a few
+// instructions, which is far below anything these tools measure.
+static inline uint64_t tsc_read() {
+#ifdef TSC_CLOCK_X86
+  return __rdtsc();
+#else
+  return tsc_clock_ns(CLOCK_MONOTONIC);
+#endif
+}
+
+static inline uint64_t tsc_ticks() {
+  if (__builtin_expect(tsc_clock.tsc, 1)) {
+    return tsc_read();
+  }
+  return tsc_clock_ns(CLOCK_MONOTONIC);
+}
+
+static inline uint64_t tsc_to_ns(uint64_t ticks) {
+  return (uint64_t)(((unsigned __int128)ticks * tsc_clock.ns_mult) >>
+                    TSC_FRAC_BITS);
+}
+
+static inline uint64_t tsc_from_ns(uint64_t ns) {
+  return (uint64_t)(((unsigned __int128)ns * tsc_clock.tick_mult) >>
+                    TSC_FRAC_BITS);
+}
+
+// CLOCK_MONOTONIC / CLOCK_REALTIME equivalents of a tick value. The realtime
+// offset is fixed at calibration, so it does not follow later NTP steps.
+static inline uint64_t tsc_mono_ns(uint64_t ticks) {
+  return tsc_clock.mono_base + tsc_to_ns(ticks - tsc_clock.tick_base);
+}
+
+static inline uint64_t tsc_realtime_ns(uint64_t ticks) {
+  return tsc_mono_ns(ticks) + tsc_clock.realtime_offset;
+}
+
+// Invariant TSC (CPUID 0x80000007 EDX bit 8) that the kernel also trusts
+// enough to use as its own clocksource.
+static inline bool tsc_reliable() {
+#ifdef TSC_CLOCK_X86
+  unsigned int eax, ebx, ecx, edx;
+  char source[32] = "";
+
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+      !(edx & (1u << 8))) {
+    return false;
+  }
+  FILE *f = fopen(
+      "/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+  if (f == NULL) {
+    return false;
+  }
+  bool ok = fgets(source, sizeof(source), f) != NULL &&
+            strncmp(source, "tsc", 3) == 0;
+  fclose(f);
+  return ok;
+#else
+  return false;
+#endif
+}
+
+// One (tsc, monotonic) pair: the TSC read bracketed by the tightest pair of
+// clock reads out of a few attempts.
+static inline void tsc_sample(uint64_t *tsc, uint64_t *mono) {
+  uint64_t best = UINT64_MAX;
+
+  for (int i = 0; i < 8; i++) {
+    uint64_t before = tsc_clock_ns(CLOCK_MONOTONIC);
+    uint64_t t = tsc_read();
+    uint64_t after = tsc_clock_ns(CLOCK_MONOTONIC);
+    if (after - before < best) {
+      best = after - before;
+      *tsc = t;
+      *mono = before + (after - before) / 2;
+    }
+  }
+}
+
+// Calibrate, or settle for the vDSO clock. Returns true if the TSC is used.
+static inline bool tsc_clock_init() {
+  uint64_t t0, m0, t1, m1;
+  struct timespec pause = {0, TSC_CALIBRATE_MS * 1000000L};
+
+  tsc_clock.realtime_offset = (int64_t)(tsc_clock_ns(CLOCK_REALTIME) -
+                                        tsc_clock_ns(CLOCK_MONOTONIC));
+  if (!tsc_reliable()) {
+    tsc_clock.tsc = false;
+    return false;
+  }
+  tsc_sample(&t0, &m0);
+  nanosleep(&pause, NULL);
+  tsc_sample(&t1, &m1);
+  tsc_clock.ns_mult = (uint64_t)(((unsigned __int128)(m1 - m0)
+                                  << TSC_FRAC_BITS) /
+                                 (t1 - t0));
+  tsc_clock.tick_mult = (uint64_t)(((unsigned __int128)(t1 - t0)
+                                    << TSC_FRAC_BITS) /
+                                   (m1 - m0));
+  tsc_clock.tick_base = t1;
+  tsc_clock.mono_base = m1;
+  tsc_clock.tsc = true;
+  return true;
+}
+
+static inline double tsc_clock_ghz() {
+  return (double)tsc_clock.tick_mult / (1ULL << TSC_FRAC_BITS);
+}
+
+// Cost of every way of taking a timestamp, in ns per call.
+static inline void tsc_clock_bench(unsigned long iterations) {
+  static const clockid_t clocks[] = {CLOCK_MONOTONIC, CLOCK_MONOTONIC_COARSE,
+                                     CLOCK_REALTIME, CLOCK_MONOTONIC_RAW};
+  static const char *clock_names[] = {"clock_gettime(MONOTONIC)",
+                                      "clock_gettime(MONOTONIC_COARSE)",
+                                      "clock_gettime(REALTIME)",
+                                      "clock_gettime(MONOTONIC_RAW)"};
+  volatile uint64_t sink = 0;
+  uint64_t start, acc;
+
+  // The loop bodies only feed acc so that none of the reads is elided.
+#define TSC_BENCH(name, expr)                                                 \
+  do {                                                                        \
+    acc = 0;                                                                  \
+    start = tsc_clock_ns(CLOCK_MONOTONIC);                                    \
+    for (unsigned long i = 0; i < iterations; i++) {                          \
+      acc += (expr);                                                          \
+    }                                                                         \
+    printf("%-34s %6.1f ns\n", name,                                          \
+           (double)(tsc_clock_ns(CLOCK_MONOTONIC) - start) / iterations);    \
+    sink = sink + acc;                                                        \
+  } while (0)
+
+#ifdef TSC_CLOCK_X86
+  unsigned int aux;
+  TSC_BENCH("rdtsc", __rdtsc());
+  TSC_BENCH("rdtscp", __rdtscp(&aux));
+  TSC_BENCH("lfence; rdtsc", (_mm_lfence(), __rdtsc()));
+#endif
+  TSC_BENCH("tsc_ticks", tsc_ticks());
+  TSC_BENCH("tsc_ticks + tsc_mono_ns", tsc_mono_ns(tsc_ticks()));
+  for (size_t c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++) {
+    TSC_BENCH(clock_names[c], tsc_clock_ns(clocks[c]));
+  }
+#undef TSC_BENCH
+
+  // How far the calibrated clock has wandered from the kernel's since init.
+  uint64_t ticks = tsc_ticks();
+  uint64_t mono = tsc_clock_ns(CLOCK_MONOTONIC);
+  printf("drift vs CLOCK_MONOTONIC          %6.1f us\n",
+         ((double)tsc_mono_ns(ticks) - (double)mono) / 1e3);
+}
+
+#endif
@@ -1,84 +1,2108 @@
 #include <arpa/inet.h>
+#include <getopt.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <linux/if_xdp.h>
+#include <linux/sock_diag.h>
+#include <net/if.h>
 #include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <cerrno>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bpf_util.h"
+#include "hdr_histogram.h"
+#include "payload_pattern.h"
+#include "run_control.h"
+#include "tsc_clock.h"
+#include "uring_util.h"
 
 #define MSG_COUNT 1024
 #define MSG_SIZE 1024
 #define PORT 12233
+// The kernel caps recvmmsg/sendmmsg vlen at UIO_MAXIOV.
+#define MAX_BATCH 1024
+#define CACHE_LINE 64
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define XSK_FRAME_SIZE 2048
+#define XSK_FRAMES 4096
+#define BUSY_POLL_BUDGET 64
+#define PACKET_BLOCK_SIZE (1 << 20)
+#define PACKET_BLOCKS 64
+#define PACKET_FRAME_SIZE 2048
+// A partially filled block is handed to userspace after this many ms.
+#define PACKET_RETIRE_MS 10
+#define EPOLL_EVENTS 64
+// Capture file unit: every write is one whole, aligned block.
+#define CAPTURE_BLOCK_SIZE (1 << 20)
+// Double buffering: one block fills while the other is being written.
+#define CAPTURE_BUFFERS 2
+#define CAPTURE_MAGIC 0x43504455 // "UDPC"
 
 static uint64_t packets = 0;
 static uint64_t bytes = 0;
+
+// One listening UDP socket and what arrived on it. The worker owning the
+// socket adds to the counters once per batch; the report takes them.
+struct rx_port {
+  uint16_t port;
+  int fd;
+  uint64_t packets;
+  uint64_t bytes;
+  uint32_t rxq_ovfl;
+  // Values of the interval being reported.
+  uint64_t interval_packets;
+  uint64_t interval_bytes;
+  uint32_t interval_drops;
+  uint32_t last_ovfl;
+};
+static std::vector<struct rx_port> rx_ports;
+
+// Fold every port's counters into the totals for this report.
+static void collect_ports() {
+  for (auto &p : rx_ports) {
+    p.interval_packets = __atomic_exchange_n(&p.packets, 0, __ATOMIC_RELAXED);
+    p.interval_bytes = __atomic_exchange_n(&p.bytes, 0, __ATOMIC_RELAXED);
+    uint32_t ovfl = __atomic_load_n(&p.rxq_ovfl, __ATOMIC_RELAXED);
+    p.interval_drops = ovfl - p.last_ovfl;
+    p.last_ovfl = ovfl;
+    packets += p.interval_packets;
+    bytes += p.interval_bytes;
+  }
+}
+// AF_XDP socket whose kernel drop counters are reported, or -1.
+static int xsk_fd = -1;
+
+// Per-CPU counters filled by the XDP counting sink.
+struct xdp_count {
+  uint64_t packets;
+  uint64_t bytes;
+};
+// Map the counting sink's program updates, or -1.
+static int xdp_count_map = -1;
+static std::vector<struct xdp_count> xdp_count_cpus;
+
+// The sink keeps running totals per CPU; sum them and turn them into the
+// per-interval counters the report prints.
+static void poll_xdp_count() {
+  static struct xdp_count last;
+  struct xdp_count total = {0, 0};
+  uint32_t key = 0;
+
+  if (bpf_map_lookup(xdp_count_map, &key, xdp_count_cpus.data()) < 0) {
+    return;
+  }
+  for (const auto &c : xdp_count_cpus) {
+    total.packets += c.packets;
+    total.bytes += c.bytes;
+  }
+  packets = total.packets - last.packets;
+  bytes = total.bytes - last.bytes;
+  last = total;
+}
+
+static void report_xsk_stats() {
+  static struct xdp_statistics last;
+  struct xdp_statistics st;
+  socklen_t len = sizeof(st);
+
+  if (getsockopt(xsk_fd, SOL_XDP, XDP_STATISTICS, &st, &len) < 0) {
+    return;
+  }
+  printf(" xsk_dropped=%llu rx_ring_full=%llu fill_empty=%llu",
+         st.rx_dropped - last.rx_dropped, st.rx_ring_full - last.rx_ring_full,
+         st.rx_fill_ring_empty_descs - last.rx_fill_ring_empty_descs);
+  last = st;
+}
+
+// Process CPU time is sampled every interval so interrupt-driven and
+// busy-polling runs can be compared on cost, not just on throughput.
+static struct rusage last_usage;
+static struct timespec last_wall;
+
+static double timeval_us(const struct timeval *tv) {
+  return tv->tv_sec * 1e6 + tv->tv_usec;
+}
+
+static void report_cpu() {
+  struct rusage usage;
+  struct timespec wall;
+
+  getrusage(RUSAGE_SELF, &usage);
+  clock_gettime(CLOCK_MONOTONIC, &wall);
+  double elapsed = (wall.tv_sec - last_wall.tv_sec) * 1e6 +
+                   (wall.tv_nsec - last_wall.tv_nsec) / 1e3;
+  if (elapsed > 0) {
+    printf(" cpu_usr=%.1f%% cpu_sys=%.1f%%",
+           100.0 * (timeval_us(&usage.ru_utime) -
+                    timeval_us(&last_usage.ru_utime)) / elapsed,
+           100.0 * (timeval_us(&usage.ru_stime) -
+                    timeval_us(&last_usage.ru_stime)) / elapsed);
+  }
+  last_usage = usage;
+  last_wall = wall;
+}
+
+// Kernel receive timestamp to recvmmsg return, per datagram (--rx-latency).
+// Workers record a batch at a time under the lock.
+static bool rx_latency = false;
+static struct hdr_histogram rx_latency_hist;
+static std::mutex rx_latency_mtx;
+
+static void report_rx_latency() {
+  std::lock_guard<std::mutex> lock(rx_latency_mtx);
+  printf(" rx_latency_us p50=%.1f p99=%.1f p99.9=%.1f max=%.1f",
+         hdr_percentile(&rx_latency_hist, 50.0) / 1e3,
+         hdr_percentile(&rx_latency_hist, 99.0) / 1e3,
+         hdr_percentile(&rx_latency_hist, 99.9) / 1e3,
+         rx_latency_hist.max / 1e3);
+  hdr_reset(&rx_latency_hist);
+}
+
+// What the TPACKET_V3 ring saw, next to what the UDP socket delivered.
+static int packet_fd = -1;
+static uint64_t ring_packets = 0;
+static uint64_t ring_bytes = 0;
+
+static void report_packet_ring() {
+  struct tpacket_stats_v3 st;
+  socklen_t len = sizeof(st);
+
+  // Written by the ring thread, so read and reset in one step.
+  printf(" ring_packets=%lu ring_bytes=%lu",
+         __atomic_exchange_n(&ring_packets, 0, __ATOMIC_RELAXED),
+         __atomic_exchange_n(&ring_bytes, 0, __ATOMIC_RELAXED));
+  // Reading PACKET_STATISTICS also resets it.
+  if (getsockopt(packet_fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+    printf(" ring_drops=%u ring_freezes=%u", st.tp_drops, st.tp_freeze_q_cnt);
+  }
+}
+
+// Drop attribution (--drops): each socket's own overflow counter as carried
+// in SO_RXQ_OVFL cmsgs, against host-wide UDP errors from /proc/net/snmp.
+static bool drops = false;
+
+struct udp_snmp {
+  uint64_t in_errors;
+  uint64_t rcvbuf_errors;
+};
+static struct udp_snmp last_snmp;
+
+// Parse the two "Udp:" lines of /proc/net/snmp. Runs from the SIGALRM
+// handler, so it sticks to open/read and hand-rolled parsing.
+static bool read_udp_snmp(struct udp_snmp *out) {
+  static char buf[8192];
+  int fd = open("/proc/net/snmp", O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) {
+    return false;
+  }
+  buf[n] = '\0';
+
+  char *names = strstr(buf, "\nUdp:");
+  char *values = names ? strstr(names + 1, "\nUdp:") : NULL;
+  if (values == NULL) {
+    return false;
+  }
+  names += 5;
+  values += 5;
+  int in_errors = -1, rcvbuf_errors = -1;
+  for (int field = 0; *names != '\n' && *names != '\0'; field++) {
+    while (*names == ' ') {
+      names++;
+    }
+    if (strncmp(names, "InErrors ", 9) == 0) {
+      in_errors = field;
+    } else if (strncmp(names, "RcvbufErrors ", 13) == 0) {
+      rcvbuf_errors = field;
+    }
+    while (*names != ' ' && *names != '\n' && *names != '\0') {
+      names++;
+    }
+  }
+  for (int field = 0; *values != '\n' && *values != '\0'; field++) {
+    uint64_t v = strtoull(values, &values, 10);
+    if (field == in_errors) {
+      out->in_errors = v;
+    } else if (field == rcvbuf_errors) {
+      out->rcvbuf_errors = v;
+    }
+  }
+  return in_errors >= 0 && rcvbuf_errors >= 0;
+}
+
+static void report_meminfo(int fd) {
+  uint32_t meminfo[SK_MEMINFO_VARS];
+  socklen_t len = sizeof(meminfo);
+
+  if (getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0) {
+    printf(" rmem=%u/%u", meminfo[SK_MEMINFO_RMEM_ALLOC],
+           meminfo[SK_MEMINFO_RCVBUF]);
+  }
+}
+
+static void report_drops() {
+  struct udp_snmp snmp;
+  uint64_t sock_drops = 0;
+
+  for (const auto &p : rx_ports) {
+    sock_drops += p.interval_drops;
+  }
+  printf(" sock_drops=%lu", sock_drops);
+  if (read_udp_snmp(&snmp)) {
+    // RcvbufErrors is the host-wide share of InErrors lost to full socket
+    // buffers; the rest is checksum, memory and similar UDP-level drops.
+    uint64_t rcvbuf = snmp.rcvbuf_errors - last_snmp.rcvbuf_errors;
+    uint64_t in = snmp.in_errors - last_snmp.in_errors;
+    printf(" udp_rcvbuf_errors=%lu udp_other_errors=%lu", rcvbuf,
+           in > rcvbuf ? in - rcvbuf : 0);
+    last_snmp = snmp;
+  }
+  if (rx_ports.size() == 1) {
+    report_meminfo(rx_ports[0].fd);
+  }
+}
+
+// With several ports, every port also gets a line of its own.
+static void report_ports() {
+  for (const auto &p : rx_ports) {
+    printf("  port=%u packets=%lu bytes=%lu", p.port, p.interval_packets,
+           p.interval_bytes);
+    if (drops) {
+      printf(" sock_drops=%u", p.interval_drops);
+      report_meminfo(p.fd);
+    }
+    printf("\n");
+  }
+}
+
+// CPU locality (--cpu-report): per receive thread, the CPUs whose softirqs
+// queued its datagrams against the CPU that consumed them, plus per-CPU
+// NET_RX softirq counts and CPU time from /proc.
+//
+// The kernel only updates SO_INCOMING_CPU for connected UDP sockets, so each
+// thread's sockets get an eBPF socket filter that counts datagrams per
+// softirq CPU instead. SO_INCOMING_CPU, sampled per batch, is the fallback
+// when the filter cannot be loaded.
+static bool cpu_report = false;
+
+struct rx_cpu_stats {
+  int consumer_cpu;
+  // SO_INCOMING_CPU fallback, per batch.
+  int softirq_cpu;
+  uint64_t batches;
+  uint64_t same_cpu;
+  uint64_t same_llc;
+  // Socket filter: datagrams per softirq CPU, cumulative in the map.
+  int map_fd;
+  int prog_fd;
+  std::vector<uint64_t> counts;
+  std::vector<uint64_t> last_counts;
+};
+static std::vector<struct rx_cpu_stats> rx_cpu_stats;
+// Last-level cache domain of every possible CPU, named by its first CPU.
+static std::vector<int> cpu_llc;
+
+struct cpu_sample {
+  uint64_t net_rx;
+  uint64_t user;
+  uint64_t system;
+  uint64_t softirq;
+  uint64_t idle;
+  uint64_t total;
+};
+// Sized once at startup; the report only overwrites them.
+static std::vector<struct cpu_sample> cpu_samples[2];
+static std::vector<int> softirq_columns;
+static std::vector<char> cpu_is_consumer;
+static int cpu_sample_current = 0;
+
+static char proc_buf[1 << 18];
+
+// Whole file into proc_buf with plain open/read, safe in the SIGALRM handler.
+static bool read_proc(const char *path) {
+  int fd = open(path, O_RDONLY);
+  size_t len = 0;
+  ssize_t n;
+
+  if (fd < 0) {
+    return false;
+  }
+  while (len < sizeof(proc_buf) - 1 &&
+         (n = read(fd, proc_buf + len, sizeof(proc_buf) - 1 - len)) > 0) {
+    len += n;
+  }
+  close(fd);
+  proc_buf[len] = '\0';
+  return len > 0;
+}
+
+static const char *parse_u64(const char *p, uint64_t *value) {
+  while (*p == ' ' || *p == '\t') {
+    p++;
+  }
+  *value = 0;
+  while (*p >= '0' && *p <= '9') {
+    *value = *value * 10 + (*p++ - '0');
+  }
+  return p;
+}
+
+static bool read_cpu_samples(std::vector<struct cpu_sample> &out) {
+  size_t ncpus = out.size(), columns = 0;
+  uint64_t v[8];
+
+  memset(out.data(), 0, ncpus * sizeof(out[0]));
+  // /proc/softirqs: a "CPUn" header, then one row per softirq.
+  if (!read_proc("/proc/softirqs")) {
+    return false;
+  }
+  const char *p = proc_buf;
+  for (; *p != '\n' && *p != '\0'; p++) {
+    if (p[0] == 'C' && p[1] == 'P' && p[2] == 'U' && columns < ncpus) {
+      uint64_t cpu;
+      p = parse_u64(p + 3, &cpu) - 1;
+      softirq_columns[columns++] = (int)cpu;
+    }
+  }
+  const char *row = strstr(p, "NET_RX:");
+  if (row != NULL) {
+    p = row + strlen("NET_RX:");
+    for (size_t c = 0; c < columns; c++) {
+      p = parse_u64(p, &v[0]);
+      if ((size_t)softirq_columns[c] < ncpus) {
+        out[softirq_columns[c]].net_rx = v[0];
+      }
+    }
+  }
+
+  // /proc/stat: "cpuN user nice system idle iowait irq softirq steal ...".
+  if (!read_proc("/proc/stat")) {
+    return false;
+  }
+  for (p = proc_buf; (p = strstr(p, "\ncpu")) != NULL;) {
+    uint64_t cpu;
+    p += 4;
+    if (*p < '0' || *p > '9') {
+      continue;
+    }
+    p = parse_u64(p, &cpu);
+    for (int i = 0; i < 8; i++) {
+      p = parse_u64(p, &v[i]);
+    }
+    if (cpu < ncpus) {
+      struct cpu_sample *s = &out[cpu];
+      s->user = v[0] + v[1];
+      s->system = v[2] + v[5];
+      s->idle = v[3] + v[4];
+      s->softirq = v[6];
+      s->total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+    }
+  }
+  return true;
+}
+
+// Socket filter that adds one to count_map[current CPU] and keeps the whole
+// datagram. It runs where the datagram is queued, i.e. in the softirq.
+static int softirq_cpu_load_prog(int count_map) {
+  struct bpf_prog_builder b;
+
+  bpf_emit(&b, BPF_EMIT_CALL(BPF_FUNC_get_smp_processor_id));
+  bpf_emit(&b, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, -4));
+  bpf_emit(&b, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+  bpf_emit(&b, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4));
+  bpf_emit_ld_map_fd(&b, BPF_REG_1, count_map);
+  bpf_emit(&b, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+  bpf_emit(&b, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 2));
+  bpf_emit(&b, BPF_MOV64_IMM(BPF_REG_1, 1));
+  bpf_emit(&b, BPF_ATOMIC_OP(BPF_DW, BPF_ADD, BPF_REG_0, BPF_REG_1, 0));
+  // Any length at least skb->len means "accept, untrimmed".
+  bpf_emit(&b, BPF_MOV64_IMM(BPF_REG_0, -1));
+  bpf_emit(&b, BPF_EXIT_INSN());
+  return bpf_prog_load(BPF_PROG_TYPE_SOCKET_FILTER, &b);
+}
+
+static int cpu_report_init(size_t threads) {
+  int ncpus = bpf_num_possible_cpus();
+  if (ncpus < 1) {
+    fprintf(stderr, "cannot read /sys/devices/system/cpu/possible\n");
+    return -1;
+  }
+  rx_cpu_stats.resize(threads);
+  for (auto &s : rx_cpu_stats) {
+    s.consumer_cpu = s.softirq_cpu = -1;
+    s.batches = s.same_cpu = s.same_llc = 0;
+    s.counts.assign(ncpus, 0);
+    s.last_counts.assign(ncpus, 0);
+    s.map_fd = bpf_map_create(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t),
+                              sizeof(uint64_t), ncpus);
+    s.prog_fd = s.map_fd >= 0 ? softirq_cpu_load_prog(s.map_fd) : -1;
+    if (s.prog_fd < 0) {
+      fprintf(stderr, "cpu-report: no socket filter, falling back to "
+                      "SO_INCOMING_CPU\n");
+      if (s.map_fd >= 0) {
+        close(s.map_fd);
+      }
+      s.map_fd = -1;
+    }
+  }
+  cpu_llc.resize(ncpus);
+  cpu_is_consumer.resize(ncpus);
+  softirq_columns.resize(ncpus);
+  cpu_samples[0].resize(ncpus);
+  cpu_samples[1].resize(ncpus);
+  for (int cpu = 0; cpu < ncpus; cpu++) {
+    char path[96];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index3/shared_cpu_list",
+             cpu);
+    FILE *f = fopen(path, "r");
+    // Without an L3 description every CPU is its own domain.
+    if (f == NULL || fscanf(f, "%d", &cpu_llc[cpu]) != 1) {
+      cpu_llc[cpu] = cpu;
+    }
+    if (f != NULL) {
+      fclose(f);
+    }
+  }
+  read_cpu_samples(cpu_samples[cpu_sample_current]);
+  return 0;
+}
+
+static bool share_llc(int a, int b) {
+  return a >= 0 && b >= 0 && (size_t)a < cpu_llc.size() &&
+         (size_t)b < cpu_llc.size() && cpu_llc[a] == cpu_llc[b];
+}
+
+static int cpu_report_attach(struct rx_cpu_stats *s, int sockfd) {
+  if (s->map_fd >= 0 && setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_BPF,
+                                   &s->prog_fd, sizeof(s->prog_fd)) < 0) {
+    perror("setsockopt(SO_ATTACH_BPF)");
+    return -1;
+  }
+  return 0;
+}
+
+// Called by a receive thread after every batch.
+static void sample_cpu_locality(struct rx_cpu_stats *s, int fd) {
+  int incoming = -1;
+  socklen_t len = sizeof(incoming);
+  int cpu = sched_getcpu();
+
+  __atomic_store_n(&s->consumer_cpu, cpu, __ATOMIC_RELAXED);
+  if (s->map_fd >= 0) {
+    return;
+  }
+  getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &incoming, &len);
+  __atomic_store_n(&s->softirq_cpu, incoming, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->batches, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->same_cpu, incoming == cpu, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->same_llc, share_llc(incoming, cpu),
+                     __ATOMIC_RELAXED);
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+  return whole != 0 ? 100.0 * part / whole : 0.0;
+}
+
+// Datagrams of the interval by softirq CPU: the busiest one, and the shares
+// queued on the consumer's CPU and on CPUs sharing its last-level cache.
+static void report_softirq_counts(size_t thread, struct rx_cpu_stats *s,
+                                  int consumer) {
+  uint64_t total = 0, on_cpu = 0, on_llc = 0, top_count = 0;
+  int top = -1;
+
+  for (uint32_t cpu = 0; cpu < s->counts.size(); cpu++) {
+    uint64_t value = s->last_counts[cpu];
+    bpf_map_lookup(s->map_fd, &cpu, &value);
+    uint64_t delta = value - s->last_counts[cpu];
+    s->last_counts[cpu] = value;
+    total += delta;
+    if (delta > top_count) {
+      top_count = delta;
+      top = (int)cpu;
+    }
+    on_cpu += (int)cpu == consumer ? delta : 0;
+    on_llc += share_llc((int)cpu, consumer) ? delta : 0;
+  }
+  printf("  thread=%zu consumer_cpu=%d softirq_cpu=%d (%.0f%%) same_cpu=%.0f%% "
+         "same_llc=%.0f%%\n",
+         thread, consumer, top, percent(top_count, total),
+         percent(on_cpu, total), percent(on_llc, total));
+}
+
+// A line per receive thread, then a line per CPU that ran NET_RX softirqs
+// or a consumer during the interval.
+static void report_cpu_locality() {
+  memset(cpu_is_consumer.data(), 0, cpu_is_consumer.size());
+  for (size_t i = 0; i < rx_cpu_stats.size(); i++) {
+    struct rx_cpu_stats *s = &rx_cpu_stats[i];
+    int cpu = __atomic_load_n(&s->consumer_cpu, __ATOMIC_RELAXED);
+    if (cpu >= 0 && (size_t)cpu < cpu_is_consumer.size()) {
+      cpu_is_consumer[cpu] = 1;
+    }
+    if (s->map_fd >= 0) {
+      report_softirq_counts(i, s, cpu);
+      continue;
+    }
+    uint64_t batches = __atomic_exchange_n(&s->batches, 0, __ATOMIC_RELAXED);
+    uint64_t same_cpu = __atomic_exchange_n(&s->same_cpu, 0, __ATOMIC_RELAXED);
+    uint64_t same_llc = __atomic_exchange_n(&s->same_llc, 0, __ATOMIC_RELAXED);
+    printf("  thread=%zu consumer_cpu=%d softirq_cpu=%d batches=%lu "
+           "same_cpu=%.0f%% same_llc=%.0f%%\n",
+           i, cpu, __atomic_load_n(&s->softirq_cpu, __ATOMIC_RELAXED),
+           batches, percent(same_cpu, batches), percent(same_llc, batches));
+  }
+
+  const std::vector<struct cpu_sample> &last = cpu_samples[cpu_sample_current];
+  std::vector<struct cpu_sample> &now = cpu_samples[cpu_sample_current ^ 1];
+  if (!read_cpu_samples(now)) {
+    return;
+  }
+  for (size_t cpu = 0; cpu < now.size(); cpu++) {
+    uint64_t net_rx = now[cpu].net_rx - last[cpu].net_rx;
+    uint64_t total = now[cpu].total - last[cpu].total;
+    if (net_rx == 0 && !cpu_is_consumer[cpu]) {
+      continue;
+    }
+    printf("  cpu=%zu net_rx=%lu usr=%.1f%% sys=%.1f%% softirq=%.1f%% "
+           "idle=%.1f%%\n",
+           cpu, net_rx, percent(now[cpu].user - last[cpu].user, total),
+           percent(now[cpu].system - last[cpu].system, total),
+           percent(now[cpu].softirq - last[cpu].softirq, total),
+           percent(now[cpu].idle - last[cpu].idle, total));
+  }
+  cpu_sample_current ^= 1;
+}
+
+// Datagrams that failed --verify (bad pattern, length or truncation).
+static bool verify = false;
+static uint64_t verify_errors = 0;
+
+// Capture to disk (--capture). Each worker fills blocks of its own and claims
+// file offsets from capture_offset; records that find no free block because
+// the disk is behind are counted as capture_drops.
+static int capture_fd = -1;
+static uint32_t capture_snaplen = 0;
+static uint64_t capture_offset = 0;
+static uint64_t capture_records = 0;
+static uint64_t capture_drops = 0;
+
 static void timer_handler(int signo) {
-  printf("packets=%lu bytes=%lu\n", packets, bytes);
+  if (xdp_count_map >= 0) {
+    poll_xdp_count();
+  }
+  collect_ports();
+  printf("packets=%lu bytes=%lu", packets, bytes);
+  if (xsk_fd >= 0) {
+    report_xsk_stats();
+  }
+  if (packet_fd >= 0) {
+    report_packet_ring();
+  }
+  if (drops) {
+    report_drops();
+  }
+  report_cpu();
+  if (rx_latency) {
+    report_rx_latency();
+  }
+  if (verify) {
+    printf(" verify_errors=%lu",
+           __atomic_exchange_n(&verify_errors, 0, __ATOMIC_RELAXED));
+  }
+  if (capture_fd >= 0) {
+    printf(" capture_records=%lu capture_drops=%lu",
+           __atomic_exchange_n(&capture_records, 0, __ATOMIC_RELAXED),
+           __atomic_exchange_n(&capture_drops, 0, __ATOMIC_RELAXED));
+  }
+  printf("\n");
+  if (rx_ports.size() > 1) {
+    report_ports();
+  }
+  if (cpu_report) {
+    report_cpu_locality();
+  }
   packets = 0;
   bytes = 0;
 }
 
-int main(int argc, char *argv[]) {
-  int retval;
-  int sockfd;
-  struct sockaddr_in addr;
-  struct mmsghdr msg[MSG_COUNT];
-  struct iovec iov[MSG_COUNT];
-  char bufs[MSG_COUNT][MSG_SIZE];
-
-  // Timer hook using SIGALRM
-  signal(SIGALRM, timer_handler);
-  struct itimerval timer = {0};
-  timer.it_value.tv_sec = 1;
-  timer.it_interval.tv_sec = 1;
-  setitimer(ITIMER_REAL, &timer, NULL);
-
-  if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-    perror("socket");
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--reflect] [--batch N] [--msg-size BYTES] "
+          "[--busy-poll USEC [--busy-poll-budget N]] [--rx-latency] "
+          "[--verify[=SEED] [--verify-kernel NAME]] "
+          "[--packet-mmap IFACE [--ring-blocks N]] [--drops] [--count-only] "
+          "[--ports LIST [--threads N]] "
+          "[--capture FILE [--capture-snaplen BYTES]] "
+          "[--control PORT [--result FILE]] [--cpu-report]\n"
+          "       %s --xdp IFACE [--xdp-queue Q] [--xdp-frames N] "
+          "[--xdp-native]\n"
+          "       %s --xdp-count IFACE [--xdp-native]\n"
+          "  --reflect         echo every datagram back to its sender with "
+          "sendmmsg\n"
+          "  --batch N         datagrams per recvmmsg call (default %d)\n"
+          "  --msg-size BYTES  receive slot size (default %d)\n"
+          "  --busy-poll USEC  SO_BUSY_POLL/SO_PREFER_BUSY_POLL and spin on a "
+          "non-blocking recvmmsg\n"
+          "  --busy-poll-budget N\n"
+          "                    SO_BUSY_POLL_BUDGET (default %d)\n"
+          "  --rx-latency      report kernel-arrival to userspace latency "
+          "(SO_TIMESTAMPNS)\n"
+          "  --verify[=SEED]   check every payload against udpsender "
+          "--verify\n"
+          "  --verify-kernel NAME\n"
+          "                    avx2, sse4.2 or scalar (default: best "
+          "supported)\n"
+          "  --packet-mmap IFACE\n"
+          "                    also receive the whole port range on IFACE "
+          "through a TPACKET_V3 ring\n"
+          "  --ring-blocks N   1 MB blocks in the ring (default %d)\n"
+          "  --drops           attribute losses: socket buffer (SO_RXQ_OVFL) "
+          "vs other UDP errors\n"
+          "  --count-only      post empty buffers with MSG_TRUNC: full lengths, "
+          "no payload copy\n"
+          "  --ports LIST      listen on every port in LIST, e.g. 12233-12240 "
+          "or 9000,9100 (default %d)\n"
+          "  --threads N       receive threads; ports are spread across them "
+          "and multiplexed with epoll (default 1)\n"
+          "  --capture FILE    append every datagram to FILE (io_uring, "
+          "O_DIRECT); stop with SIGINT\n"
+          "  --capture-snaplen BYTES\n"
+          "                    payload bytes kept per datagram (default: "
+          "all)\n"
+          "  --control PORT    let a udpsender --control run windows on TCP "
+          "PORT, exit when it is done\n"
+          "  --result FILE     also write the run summary to FILE\n"
+          "  --cpu-report      per thread softirq vs consumer CPU, per CPU "
+          "NET_RX and time split\n"
+          "  --xdp IFACE       receive through an AF_XDP socket on IFACE "
+          "(generic XDP)\n"
+          "  --xdp-queue Q     receive queue to bind (default 0)\n"
+          "  --xdp-frames N    UMEM frames, a power of two (default %d)\n"
+          "  --xdp-count IFACE count and drop the first port in XDP; no socket "
+          "at all\n"
+          "  --xdp-native      attach in driver mode instead of generic mode\n",
+          prog, prog, prog, MSG_COUNT, MSG_SIZE, BUSY_POLL_BUDGET,
+          PACKET_BLOCKS, PORT, XSK_FRAMES);
+}
+
+static size_t align_up(size_t value, size_t align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+// Everything one recvmmsg batch touches, carved out of a single mapping: the
+// mmsghdr, iovec, source address and control buffer arrays back to back,
+// followed by the cache-line aligned payload slots.
+struct rx_arena {
+  struct mmsghdr *msg;
+  struct iovec *iov;
+  struct sockaddr_in *peers;
+  char *control;
+  char *payload;
+  unsigned int count;
+  size_t msg_size;
+  size_t slot_size;
+  size_t ctrl_size;
+  void *base;
+  size_t length;
+};
+
+// Map length bytes with explicit 2 MB huge pages, falling back to an ordinary
+// mapping that asks for transparent huge pages.
+static void *huge_map(size_t length, const char *what) {
+  void *p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1,
+                 0);
+  if (p != MAP_FAILED) {
+    fprintf(stderr, "%s: %zu bytes, 2 MB huge pages\n", what, length);
+    return p;
+  }
+  p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+           -1, 0);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    return NULL;
+  }
+  madvise(p, length, MADV_HUGEPAGE);
+  fprintf(stderr, "%s: %zu bytes, transparent huge pages\n", what, length);
+  return p;
+}
+
+// ctrl_size is the ancillary data space per datagram, 0 for none.
+static int arena_init(struct rx_arena *a, unsigned int count, size_t msg_size,
+                      bool want_peers, size_t ctrl_size) {
+  size_t headers = align_up(count * sizeof(struct mmsghdr), CACHE_LINE);
+  size_t iovecs = align_up(count * sizeof(struct iovec), CACHE_LINE);
+  size_t peers = align_up(count * sizeof(struct sockaddr_in), CACHE_LINE);
+
+  memset(a, 0, sizeof(*a));
+  a->count = count;
+  a->msg_size = msg_size;
+  a->slot_size = align_up(msg_size, CACHE_LINE);
+  a->ctrl_size = align_up(ctrl_size, sizeof(size_t));
+  size_t controls = align_up(count * a->ctrl_size, CACHE_LINE);
+  a->length = align_up(headers + iovecs + peers + controls +
+                           count * a->slot_size,
+                       HUGE_PAGE_SIZE);
+
+  if ((a->base = huge_map(a->length, "arena")) == NULL) {
+    return -1;
+  }
+
+  char *p = (char *)a->base;
+  a->msg = (struct mmsghdr *)p;
+  a->iov = (struct iovec *)(p + headers);
+  a->peers = (struct sockaddr_in *)(p + headers + iovecs);
+  a->control = p + headers + iovecs + peers;
+  a->payload = p + headers + iovecs + peers + controls;
+
+  for (unsigned int i = 0; i < count; i++) {
+    a->iov[i].iov_base = a->payload + i * a->slot_size;
+    a->iov[i].iov_len = msg_size;
+    a->msg[i].msg_hdr.msg_iov = &a->iov[i];
+    a->msg[i].msg_hdr.msg_iovlen = 1;
+    // Source addresses are only needed to answer in reflector mode.
+    if (want_peers) {
+      a->msg[i].msg_hdr.msg_name = &a->peers[i];
+      a->msg[i].msg_hdr.msg_namelen = sizeof(a->peers[i]);
+    }
+    if (a->ctrl_size != 0) {
+      a->msg[i].msg_hdr.msg_control = a->control + i * a->ctrl_size;
+      a->msg[i].msg_hdr.msg_controllen = a->ctrl_size;
+    }
+  }
+  return 0;
+}
+
+// recvmmsg shrinks msg_controllen to what it wrote; give the slots that were
+// used their full control space back.
+static void arena_rearm_control(struct rx_arena *a, int count) {
+  for (int i = 0; i < count; i++) {
+    a->msg[i].msg_hdr.msg_controllen = a->ctrl_size;
+  }
+}
+
+static void arena_free(struct rx_arena *a) {
+  munmap(a->base, a->length);
+}
+
+// Send a received batch back to where it came from. The iovecs are trimmed to
+// the received lengths for the send and restored for the next recvmmsg. The
+// received cmsgs (timestamps, drop counters) are not valid send-side control
+// data, so the control buffers are detached for the send as well.
+static void reflect_batch(int sockfd, struct rx_arena *a, int count) {
+  struct mmsghdr *msg = a->msg;
+  struct iovec *iov = a->iov;
+  int sent = 0;
+
+  for (int i = 0; i < count; i++) {
+    iov[i].iov_len = msg[i].msg_len;
+    msg[i].msg_hdr.msg_control = NULL;
+    msg[i].msg_hdr.msg_controllen = 0;
+  }
+  while (sent < count) {
+    int retval = sendmmsg(sockfd, msg + sent, count - sent, 0);
+    if (retval < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("sendmmsg");
+      exit(EXIT_FAILURE);
+    }
+    sent += retval;
+  }
+  for (int i = 0; i < count; i++) {
+    iov[i].iov_len = a->msg_size;
+    msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    if (a->ctrl_size != 0) {
+      msg[i].msg_hdr.msg_control = a->control + i * a->ctrl_size;
+      msg[i].msg_hdr.msg_controllen = a->ctrl_size;
+    }
+  }
+}
+
+// One of the four single-producer/single-consumer rings of an AF_XDP socket.
+struct xsk_ring {
+  uint32_t *producer;
+  uint32_t *consumer;
+  void *desc;
+  uint32_t mask;
+};
+
+static int xsk_map_ring(int fd, const struct xdp_ring_offset *off,
+                        uint32_t size, size_t desc_size, off_t pgoff,
+                        struct xsk_ring *ring) {
+  void *map = mmap(NULL, off->desc + size * desc_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, pgoff);
+  if (map == MAP_FAILED) {
+    perror("mmap xsk ring");
+    return -1;
+  }
+  ring->producer = (uint32_t *)((char *)map + off->producer);
+  ring->consumer = (uint32_t *)((char *)map + off->consumer);
+  ring->desc = (char *)map + off->desc;
+  ring->mask = size - 1;
+  return 0;
+}
+
+// XDP program that redirects our UDP port into the AF_XDP socket registered
+// for the receive queue and passes everything else to the stack.
+static int xsk_load_prog(int xsks_map, uint16_t port) {
+  struct bpf_prog_builder b;
+
+  bpf_emit_xdp_udp_match(&b, port);
+  bpf_emit_ld_map_fd(&b, BPF_REG_1, xsks_map);
+  bpf_emit(&b, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6,
+                           offsetof(struct xdp_md, rx_queue_index)));
+  bpf_emit(&b, BPF_MOV64_IMM(BPF_REG_3, XDP_PASS));
+  bpf_emit(&b, BPF_EMIT_CALL(BPF_FUNC_redirect_map));
+  bpf_emit(&b, BPF_EXIT_INSN());
+  bpf_resolve(&b);
+  bpf_emit(&b, BPF_MOV64_IMM(BPF_REG_0, XDP_PASS));
+  bpf_emit(&b, BPF_EXIT_INSN());
+  return bpf_prog_load(BPF_PROG_TYPE_XDP, &b);
+}
+
+// XDP program that counts our UDP port into a per-CPU array and drops it.
+// Bytes are UDP payload bytes, as recvmmsg would have reported them.
+static int xdp_count_load_prog(int count_map, uint16_t port) {
+  const int l4 = ETH_HLEN + 20;
+  struct bpf_prog_builder b;
+
+  bpf_emit_xdp_udp_match(&b, port);
+  bpf_emit(&b, BPF_LDX_MEM(BPF_H, BPF_REG_7, BPF_REG_2, l4 + 4));
+  bpf_emit(&b, BPF_ENDIAN(BPF_TO_BE, BPF_REG_7, 16));
+  bpf_emit(&b, BPF_ALU64_IMM(BPF_SUB, BPF_REG_7, 8));
+  bpf_emit(&b, BPF_ST_MEM(BPF_W, BPF_REG_10, -4, 0));
+  bpf_emit(&b, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+  bpf_emit(&b, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4));
+  bpf_emit_ld_map_fd(&b, BPF_REG_1, count_map);
+  bpf_emit(&b, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+  // Skip the six counter updates if the lookup failed.
+  bpf_emit(&b, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 6));
+  bpf_emit(&b, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_0,
+                           offsetof(struct xdp_count, packets)));
+  bpf_emit(&b, BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, 1));
+  bpf_emit(&b, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_1,
+                           offsetof(struct xdp_count, packets)));
+  bpf_emit(&b, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_0,
+                           offsetof(struct xdp_count, bytes)));
+  bpf_emit(&b, BPF_ALU64_REG(BPF_ADD, BPF_REG_1, BPF_REG_7));
+  bpf_emit(&b, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_1,
+                           offsetof(struct xdp_count, bytes)));
+  bpf_emit(&b, BPF_MOV64_IMM(BPF_REG_0, XDP_DROP));
+  bpf_emit(&b, BPF_EXIT_INSN());
+  bpf_resolve(&b);
+  bpf_emit(&b, BPF_MOV64_IMM(BPF_REG_0, XDP_PASS));
+  bpf_emit(&b, BPF_EXIT_INSN());
+  return bpf_prog_load(BPF_PROG_TYPE_XDP, &b);
+}
+
+// Wire-plus-driver baseline: packets never reach a socket, and userspace only
+// sums the per-CPU map from the once-per-second report.
+static int run_xdp_count(const char *ifname, uint16_t port,
+                         uint32_t attach_flags) {
+  unsigned int ifindex = if_nametoindex(ifname);
+  if (ifindex == 0) {
+    perror(ifname);
     return 1;
   }
 
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(PORT);
-  addr.sin_addr.s_addr = inet_addr("0.0.0.0");
+  int ncpus = bpf_num_possible_cpus();
+  if (ncpus < 1) {
+    fprintf(stderr, "cannot read /sys/devices/system/cpu/possible\n");
+    return 1;
+  }
+  xdp_count_cpus.resize(ncpus);
+
+  int count_map = bpf_map_create(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(uint32_t),
+                                 sizeof(struct xdp_count), 1);
+  if (count_map < 0) {
+    perror("bpf(BPF_MAP_CREATE)");
+    return 1;
+  }
+  int prog = xdp_count_load_prog(count_map, port);
+  if (prog < 0) {
+    return 1;
+  }
+  if (bpf_xdp_attach(ifindex, prog, attach_flags) < 0) {
+    perror("bpf(BPF_LINK_CREATE)");
+    return 1;
+  }
+  xdp_count_map = count_map;
+
+  while (1) {
+    pause();
+  }
+
+  return 0;
+}
+
+// Kernel-bypass receive: frames land in a UMEM we own, are parsed here and
+// handed straight back to the kernel through the fill ring.
+static int run_afxdp(const char *ifname, uint16_t port, uint32_t queue,
+                     uint32_t frames, uint32_t attach_flags) {
+  unsigned int ifindex = if_nametoindex(ifname);
+  if (ifindex == 0) {
+    perror(ifname);
+    return 1;
+  }
+
+  size_t umem_len = (size_t)frames * XSK_FRAME_SIZE;
+  char *umem = (char *)huge_map(umem_len, "umem");
+  if (umem == NULL) {
+    return 1;
+  }
 
-  memset(msg, 0, sizeof(msg));
-  for (int i = 0; i < MSG_COUNT; i++) {
-    iov[i].iov_base = bufs[i];
-    iov[i].iov_len = MSG_SIZE;
-    msg[i].msg_hdr.msg_iov = &iov[i];
-    msg[i].msg_hdr.msg_iovlen = 1;
+  int fd = socket(AF_XDP, SOCK_RAW, 0);
+  if (fd < 0) {
+    perror("socket(AF_XDP)");
+    return 1;
   }
 
-  if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    perror("bind");
+  struct xdp_umem_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.addr = (uint64_t)(uintptr_t)umem;
+  reg.len = umem_len;
+  reg.chunk_size = XSK_FRAME_SIZE;
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+    perror("setsockopt(XDP_UMEM_REG)");
+    return 1;
+  }
+  // The completion ring is unused on a receive-only socket but bind()
+  // refuses a UMEM without one.
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &frames, sizeof(frames)) <
+          0 ||
+      setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &frames,
+                 sizeof(frames)) < 0 ||
+      setsockopt(fd, SOL_XDP, XDP_RX_RING, &frames, sizeof(frames)) < 0) {
+    perror("setsockopt(XDP rings)");
     return 1;
   }
 
+  struct xdp_mmap_offsets off;
+  socklen_t optlen = sizeof(off);
+  if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+    perror("getsockopt(XDP_MMAP_OFFSETS)");
+    return 1;
+  }
+  struct xsk_ring fq, cq, rx;
+  if (xsk_map_ring(fd, &off.fr, frames, sizeof(uint64_t),
+                   XDP_UMEM_PGOFF_FILL_RING, &fq) < 0 ||
+      xsk_map_ring(fd, &off.cr, frames, sizeof(uint64_t),
+                   XDP_UMEM_PGOFF_COMPLETION_RING, &cq) < 0 ||
+      xsk_map_ring(fd, &off.rx, frames, sizeof(struct xdp_desc),
+                   XDP_PGOFF_RX_RING, &rx) < 0) {
+    return 1;
+  }
+
+  // Every frame starts out owned by the kernel.
+  uint64_t *fill = (uint64_t *)fq.desc;
+  for (uint32_t i = 0; i < frames; i++) {
+    fill[i] = (uint64_t)i * XSK_FRAME_SIZE;
+  }
+  __atomic_store_n(fq.producer, frames, __ATOMIC_RELEASE);
+
+  struct sockaddr_xdp sxdp;
+  memset(&sxdp, 0, sizeof(sxdp));
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = ifindex;
+  sxdp.sxdp_queue_id = queue;
+  // Generic XDP can only copy into the UMEM.
+  sxdp.sxdp_flags = (attach_flags & XDP_FLAGS_SKB_MODE) ? XDP_COPY : 0;
+  if (bind(fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+    perror("bind(AF_XDP)");
+    return 1;
+  }
+
+  int xsks_map = bpf_map_create(BPF_MAP_TYPE_XSKMAP, sizeof(uint32_t),
+                                sizeof(uint32_t), queue + 1);
+  if (xsks_map < 0) {
+    perror("bpf(BPF_MAP_CREATE)");
+    return 1;
+  }
+  if (bpf_map_update(xsks_map, &queue, &fd) < 0) {
+    perror("bpf(BPF_MAP_UPDATE_ELEM)");
+    return 1;
+  }
+  int prog = xsk_load_prog(xsks_map, port);
+  if (prog < 0) {
+    return 1;
+  }
+  if (bpf_xdp_attach(ifindex, prog, attach_flags) < 0) {
+    perror("bpf(BPF_LINK_CREATE)");
+    return 1;
+  }
+  xsk_fd = fd;
+
+  const struct xdp_desc *descs = (const struct xdp_desc *)rx.desc;
+  struct pollfd pfd = {fd, POLLIN, 0};
   while (1) {
-    retval = recvmmsg(sockfd, msg, MSG_COUNT, MSG_WAITFORONE, NULL);
+    uint32_t cons = *rx.consumer;
+    uint32_t avail = __atomic_load_n(rx.producer, __ATOMIC_ACQUIRE) - cons;
+    if (avail == 0) {
+      if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+        perror("poll");
+        exit(EXIT_FAILURE);
+      }
+      continue;
+    }
+
+    uint32_t prod = *fq.producer;
+    for (uint32_t i = 0; i < avail; i++) {
+      const struct xdp_desc *d = &descs[(cons + i) & rx.mask];
+      const char *frame = umem + d->addr;
+      const struct iphdr *ip = (const struct iphdr *)(frame + ETH_HLEN);
+      const struct udphdr *udp =
+          (const struct udphdr *)((const char *)ip + ip->ihl * 4);
+      bytes += ntohs(udp->len) - sizeof(*udp);
+      // Rx addresses point past the kernel's headroom; recycle the chunk.
+      fill[(prod + i) & fq.mask] = d->addr & ~(uint64_t)(XSK_FRAME_SIZE - 1);
+    }
+    __atomic_store_n(fq.producer, prod + avail, __ATOMIC_RELEASE);
+    __atomic_store_n(rx.consumer, cons + avail, __ATOMIC_RELEASE);
+    packets += avail;
+  }
+
+  return 0;
+}
+
+// Memory-mapped TPACKET_V3 receive ring of an AF_PACKET socket.
+struct packet_ring {
+  char *map;
+  unsigned int blocks;
+};
+
+// Open a packet socket on ifname that only sees unfragmented IPv4 UDP to a
+// port in [lo, hi], and map its block-based receive ring.
+static int packet_ring_open(const char *ifname, uint16_t lo, uint16_t hi,
+                            unsigned int blocks, struct packet_ring *ring) {
+  struct sock_filter code[] = {
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 9),
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, ETH_HLEN + 9),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 7),
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, ETH_HLEN + 6),
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x3fff, 5, 0),
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, ETH_HLEN),
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, ETH_HLEN + 2),
+      BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, lo, 0, 2),
+      BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, hi, 1, 0),
+      BPF_STMT(BPF_RET | BPF_K, 0x40000),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog filter = {sizeof(code) / sizeof(code[0]), code};
+  int version = TPACKET_V3;
+
+  unsigned int ifindex = if_nametoindex(ifname);
+  if (ifindex == 0) {
+    perror(ifname);
+    return -1;
+  }
+  // Protocol 0 receives nothing until bind, so the filter is in place first.
+  int fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (fd < 0) {
+    perror("socket(AF_PACKET)");
+    return -1;
+  }
+  if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) <
+      0) {
+    perror("setsockopt(SO_ATTACH_FILTER)");
+    return -1;
+  }
+  if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) <
+      0) {
+    perror("setsockopt(PACKET_VERSION)");
+    return -1;
+  }
+
+  struct tpacket_req3 req;
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = PACKET_BLOCK_SIZE;
+  req.tp_block_nr = blocks;
+  req.tp_frame_size = PACKET_FRAME_SIZE;
+  req.tp_frame_nr = PACKET_BLOCK_SIZE / PACKET_FRAME_SIZE * blocks;
+  req.tp_retire_blk_tov = PACKET_RETIRE_MS;
+  if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+    perror("setsockopt(PACKET_RX_RING)");
+    return -1;
+  }
+  ring->blocks = blocks;
+  ring->map = (char *)mmap(NULL, (size_t)PACKET_BLOCK_SIZE * blocks,
+                           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           fd, 0);
+  if (ring->map == MAP_FAILED) {
+    perror("mmap(PACKET_RX_RING)");
+    return -1;
+  }
+
+  struct sockaddr_ll sll;
+  memset(&sll, 0, sizeof(sll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(ETH_P_IP);
+  sll.sll_ifindex = ifindex;
+  if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+    perror("bind(AF_PACKET)");
+    return -1;
+  }
+  return fd;
+}
+
+// Walk the ring one retired block at a time: every frame in a block is
+// accounted, then the whole block goes back to the kernel at once.
+static void packet_ring_loop(int fd, struct packet_ring ring) {
+  struct pollfd pfd = {fd, POLLIN | POLLERR, 0};
+  unsigned int current = 0;
+
+  while (1) {
+    struct tpacket_block_desc *bd = (struct tpacket_block_desc *)(
+        ring.map + (size_t)current * PACKET_BLOCK_SIZE);
+    if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+          TP_STATUS_USER)) {
+      poll(&pfd, 1, -1);
+      continue;
+    }
+
+    uint32_t count = bd->hdr.bh1.num_pkts;
+    uint64_t block_bytes = 0;
+    const struct tpacket3_hdr *ph = (const struct tpacket3_hdr *)(
+        (const char *)bd + bd->hdr.bh1.offset_to_first_pkt);
+    for (uint32_t i = 0; i < count; i++) {
+      const struct iphdr *ip =
+          (const struct iphdr *)((const char *)ph + ph->tp_mac + ETH_HLEN);
+      const struct udphdr *udp =
+          (const struct udphdr *)((const char *)ip + ip->ihl * 4);
+      block_bytes += ntohs(udp->len) - sizeof(*udp);
+      ph = (const struct tpacket3_hdr *)((const char *)ph +
+                                         ph->tp_next_offset);
+    }
+    __atomic_fetch_add(&ring_packets, count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ring_bytes, block_bytes, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+    current = (current + 1) % ring.blocks;
+  }
+}
+
+static void verify_batch(const struct rx_arena *a, int count,
+                         pattern_verify_fn check, uint32_t seed) {
+  uint64_t errors = 0;
+
+  for (int i = 0; i < count; i++) {
+    const struct mmsghdr *m = &a->msg[i];
+    errors += (m->msg_hdr.msg_flags & MSG_TRUNC) ||
+              !check((const char *)a->iov[i].iov_base, m->msg_len, seed);
+  }
+  if (errors != 0) {
+    __atomic_fetch_add(&verify_errors, errors, __ATOMIC_RELAXED);
+  }
+}
+
+// Walk the ancillary data of a batch once for every feature that asked for
+// some, then give the slots their control space back.
+static void process_control(struct rx_port *port, struct rx_arena *a,
+                            int count) {
+  struct timespec now;
+  std::unique_lock<std::mutex> lock(rx_latency_mtx, std::defer_lock);
+
+  // Kernel timestamps follow NTP, so this one is read from the same clock
+  // rather than derived from the TSC.
+  if (rx_latency) {
+    clock_gettime(CLOCK_REALTIME, &now);
+    lock.lock();
+  }
+  for (int i = 0; i < count; i++) {
+    struct msghdr *mh = &a->msg[i].msg_hdr;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(mh); c != NULL;
+         c = CMSG_NXTHDR(mh, c)) {
+      if (c->cmsg_level != SOL_SOCKET) {
+        continue;
+      }
+      if (c->cmsg_type == SCM_TIMESTAMPNS) {
+        struct timespec ts;
+        memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        int64_t ns = (now.tv_sec - ts.tv_sec) * 1000000000LL +
+                     (now.tv_nsec - ts.tv_nsec);
+        hdr_record(&rx_latency_hist, ns > 0 ? ns : 0);
+      } else if (c->cmsg_type == SO_RXQ_OVFL) {
+        // Cumulative drop count as of when this datagram was queued; only
+        // sent once the socket has dropped something.
+        uint32_t ovfl;
+        memcpy(&ovfl, CMSG_DATA(c), sizeof(ovfl));
+        __atomic_store_n(&port->rxq_ovfl, ovfl, __ATOMIC_RELAXED);
+      }
+    }
+  }
+  arena_rearm_control(a, count);
+}
+
+// Busy polling makes recvmmsg poll the device queue from process context
+// instead of waiting for the softirq. For the full effect the device also
+// needs napi_defer_hard_irqs and gro_flush_timeout set.
+static int enable_busy_poll(int sockfd, int usec, int budget) {
+  int one = 1;
+
+  if (setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) {
+    perror("setsockopt(SO_BUSY_POLL)");
+    return -1;
+  }
+  if (setsockopt(sockfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one,
+                 sizeof(one)) < 0) {
+    perror("setsockopt(SO_PREFER_BUSY_POLL)");
+    return -1;
+  }
+  if (setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget,
+                 sizeof(budget)) < 0) {
+    perror("setsockopt(SO_BUSY_POLL_BUDGET)");
+    return -1;
+  }
+  if (fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK) < 0) {
+    perror("fcntl(O_NONBLOCK)");
+    return -1;
+  }
+  return 0;
+}
+
+// Capture file format: a sequence of CAPTURE_BLOCK_SIZE blocks, each a
+// capture_block header followed by `used` bytes of records. A record is a
+// capture_record followed by caplen payload bytes, padded to 8 bytes. Blocks
+// from different workers interleave, so readers walk the file block by block.
+struct capture_block {
+  uint32_t magic;
+  uint32_t used;
+  uint32_t records;
+  uint32_t reserved;
+};
+
+struct capture_record {
+  uint64_t ts_ns; // CLOCK_REALTIME when the batch was received, via the TSC
+  uint32_t len;   // datagram length
+  uint32_t caplen;
+  uint16_t port;
+  uint16_t reserved[3];
+};
+
+// Per-worker writer: O_DIRECT writes of whole blocks go through a private
+// io_uring, so the receive loop only ever copies into memory.
+struct capture_writer {
+  struct uring ring;
+  char *buffers;
+  bool busy[CAPTURE_BUFFERS];
+  uint32_t records[CAPTURE_BUFFERS];
+  unsigned current;
+  size_t fill;
+};
+
+static int capture_writer_init(struct capture_writer *w) {
+  memset(w, 0, sizeof(*w));
+  if (uring_init(&w->ring, CAPTURE_BUFFERS) < 0) {
+    return -1;
+  }
+  w->buffers = (char *)huge_map((size_t)CAPTURE_BLOCK_SIZE * CAPTURE_BUFFERS,
+                                "capture");
+  if (w->buffers == NULL) {
+    return -1;
+  }
+  w->fill = sizeof(struct capture_block);
+  return 0;
+}
+
+// Retire finished writes, waiting for at least one if asked to.
+static void capture_reap(struct capture_writer *w, bool wait) {
+  struct io_uring_cqe *cqe;
+
+  if (wait && uring_submit(&w->ring, 1) < 0 && errno != EINTR) {
+    perror("io_uring_enter");
+  }
+  while ((cqe = uring_peek_cqe(&w->ring)) != NULL) {
+    unsigned index = (unsigned)cqe->user_data;
+    if (cqe->res == CAPTURE_BLOCK_SIZE) {
+      __atomic_fetch_add(&capture_records, w->records[index],
+                         __ATOMIC_RELAXED);
+    } else {
+      fprintf(stderr, "capture write: %s\n",
+              cqe->res < 0 ? strerror(-cqe->res) : "short write");
+      __atomic_fetch_add(&capture_drops, w->records[index], __ATOMIC_RELAXED);
+    }
+    w->records[index] = 0;
+    w->busy[index] = false;
+    uring_cqe_seen(&w->ring);
+  }
+}
+
+// Queue the current block for writing and move on to the next buffer, which
+// may still be in flight.
+static void capture_seal(struct capture_writer *w) {
+  char *block = w->buffers + (size_t)w->current * CAPTURE_BLOCK_SIZE;
+  struct capture_block hdr = {CAPTURE_MAGIC,
+                              (uint32_t)(w->fill - sizeof(hdr)),
+                              w->records[w->current], 0};
+
+  memcpy(block, &hdr, sizeof(hdr));
+  memset(block + w->fill, 0, CAPTURE_BLOCK_SIZE - w->fill);
+  // There are as many SQEs as buffers, so one is always free here.
+  struct io_uring_sqe *sqe = uring_get_sqe(&w->ring);
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = capture_fd;
+  sqe->addr = (uint64_t)(uintptr_t)block;
+  sqe->len = CAPTURE_BLOCK_SIZE;
+  sqe->off = __atomic_fetch_add(&capture_offset, CAPTURE_BLOCK_SIZE,
+                                __ATOMIC_RELAXED);
+  sqe->user_data = w->current;
+  w->busy[w->current] = true;
+  if (uring_submit(&w->ring, 0) < 0) {
+    perror("io_uring_enter");
+  }
+  w->current = (w->current + 1) % CAPTURE_BUFFERS;
+  w->fill = sizeof(hdr);
+}
+
+static void capture_batch(struct capture_writer *w, const struct rx_port *port,
+                          const struct rx_arena *a, int count) {
+  uint64_t now = tsc_realtime_ns(tsc_ticks());
+  uint64_t dropped = 0;
+
+  capture_reap(w, false);
+  for (int i = 0; i < count; i++) {
+    struct capture_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.ts_ns = now;
+    rec.len = a->msg[i].msg_len;
+    rec.caplen = rec.len < capture_snaplen ? rec.len : capture_snaplen;
+    if (rec.caplen > a->msg_size) {
+      rec.caplen = a->msg_size;
+    }
+    rec.port = port->port;
+    size_t need = align_up(sizeof(rec) + rec.caplen, 8);
+
+    if (w->fill + need > CAPTURE_BLOCK_SIZE) {
+      capture_seal(w);
+    }
+    if (w->busy[w->current]) {
+      dropped++;
+      continue;
+    }
+    char *p = w->buffers + (size_t)w->current * CAPTURE_BLOCK_SIZE + w->fill;
+    memcpy(p, &rec, sizeof(rec));
+    memcpy(p + sizeof(rec), a->iov[i].iov_base, rec.caplen);
+    w->fill += need;
+    w->records[w->current]++;
+  }
+  if (dropped != 0) {
+    __atomic_fetch_add(&capture_drops, dropped, __ATOMIC_RELAXED);
+  }
+}
+
+// Write out the partial block and wait for everything in flight.
+static void capture_finish(struct capture_writer *w) {
+  if (w->fill > sizeof(struct capture_block) && !w->busy[w->current]) {
+    capture_seal(w);
+  }
+  for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+    while (w->busy[i]) {
+      capture_reap(w, true);
+    }
+  }
+  munmap(w->buffers, (size_t)CAPTURE_BLOCK_SIZE * CAPTURE_BUFFERS);
+  uring_free(&w->ring);
+}
+
+// Everything a receive worker needs to know about the run, fixed before the
+// first worker starts.
+struct rx_config {
+  bool reflect;
+  pattern_verify_fn verify_fn;
+  uint32_t verify_seed;
+  size_t ctrl_size;
+  int recv_flags;
+  int batch;
+  int msg_size;
+  bool busy_poll;
+};
+static struct rx_config rx_cfg;
+
+// Set by SIGINT/SIGTERM: workers return, which flushes their captures.
+static volatile sig_atomic_t stopping = 0;
+
+static void stop_handler(int signo) { stopping = 1; }
+
+// Per receive thread state.
+struct rx_thread {
+  struct rx_arena arena;
+  struct capture_writer *cap;
+  struct rx_cpu_stats *cpu;
+};
+
+static void handle_batch(struct rx_port *port, struct rx_thread *t,
+                         int count) {
+  struct rx_arena *a = &t->arena;
+  uint64_t batch_bytes = 0;
+
+  if (rx_cfg.ctrl_size != 0) {
+    process_control(port, a, count);
+  }
+  if (rx_cfg.verify_fn != NULL) {
+    verify_batch(a, count, rx_cfg.verify_fn, rx_cfg.verify_seed);
+  }
+  if (t->cap != NULL) {
+    capture_batch(t->cap, port, a, count);
+  }
+  if (rx_cfg.reflect) {
+    reflect_batch(port->fd, a, count);
+  }
+  // Only the first count entries were written by the kernel.
+  for (int i = 0; i < count; i++) {
+    batch_bytes += a->msg[i].msg_len;
+  }
+  __atomic_fetch_add(&port->packets, count, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&port->bytes, batch_bytes, __ATOMIC_RELAXED);
+  if (t->cpu != NULL) {
+    sample_cpu_locality(t->cpu, port->fd);
+  }
+}
+
+// A worker with a single socket just sits in recvmmsg.
+static void rx_blocking_loop(struct rx_port *port, struct rx_thread *t) {
+  struct rx_arena *a = &t->arena;
+
+  while (!stopping) {
+    int retval = recvmmsg(port->fd, a->msg, a->count, rx_cfg.recv_flags, NULL);
     if (retval < 0) {
-      if (errno == EINTR) {
+      if (errno == EINTR || errno == EAGAIN) {
         continue;
       }
       perror("recvmmsg");
       exit(EXIT_FAILURE);
-    } else {
-      packets += retval;
-      for (int i = 0; i < MSG_COUNT; i++) {
-        auto *m = &msg[i];
-        bytes += m->msg_len;
-        m->msg_len = 0;
+    }
+    // After shutdown() recvmmsg reports one empty datagram.
+    if (stopping) {
+      break;
+    }
+    handle_batch(port, t, retval);
+  }
+}
+
+// A worker with several sockets waits on all of them in one edge-triggered
+// epoll set and drains each ready socket until it would block.
+static void rx_epoll_loop(const std::vector<struct rx_port *> &ports,
+                          struct rx_thread *t) {
+  struct rx_arena *a = &t->arena;
+  struct epoll_event events[EPOLL_EVENTS];
+  int epfd = epoll_create1(0);
+  if (epfd < 0) {
+    perror("epoll_create1");
+    exit(EXIT_FAILURE);
+  }
+  for (struct rx_port *port : ports) {
+    struct epoll_event ev;
+    if (fcntl(port->fd, F_SETFL, fcntl(port->fd, F_GETFL) | O_NONBLOCK) < 0) {
+      perror("fcntl(O_NONBLOCK)");
+      exit(EXIT_FAILURE);
+    }
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = port;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, port->fd, &ev) < 0) {
+      perror("epoll_ctl");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // With busy polling the wait spins too instead of sleeping.
+  int timeout = rx_cfg.busy_poll ? 0 : -1;
+  int flags = rx_cfg.recv_flags | MSG_DONTWAIT;
+  while (!stopping) {
+    int ready = epoll_wait(epfd, events, EPOLL_EVENTS, timeout);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
+      exit(EXIT_FAILURE);
+    }
+    for (int e = 0; e < ready; e++) {
+      struct rx_port *port = (struct rx_port *)events[e].data.ptr;
+      int retval;
+      // A short batch means the queue was emptied, which saves the extra
+      // recvmmsg that would only return EAGAIN.
+      do {
+        retval = recvmmsg(port->fd, a->msg, a->count, flags, NULL);
+        if (retval < 0) {
+          if (errno == EINTR) {
+            retval = (int)a->count;
+            continue;
+          }
+          if (errno == EAGAIN) {
+            break;
+          }
+          perror("recvmmsg");
+          exit(EXIT_FAILURE);
+        }
+        if (stopping) {
+          return;
+        }
+        handle_batch(port, t, retval);
+      } while (retval == (int)a->count);
+    }
+  }
+}
+
+static void rx_worker(std::vector<struct rx_port *> ports, size_t id) {
+  struct rx_thread t;
+  struct capture_writer writer;
+
+  if (arena_init(&t.arena, rx_cfg.batch, rx_cfg.msg_size, rx_cfg.reflect,
+                 rx_cfg.ctrl_size) < 0) {
+    exit(EXIT_FAILURE);
+  }
+  t.cap = NULL;
+  if (capture_fd >= 0) {
+    if (capture_writer_init(&writer) < 0) {
+      exit(EXIT_FAILURE);
+    }
+    t.cap = &writer;
+  }
+  t.cpu = cpu_report ? &rx_cpu_stats[id] : NULL;
+  if (ports.size() == 1) {
+    rx_blocking_loop(ports[0], &t);
+  } else {
+    rx_epoll_loop(ports, &t);
+  }
+  if (t.cap != NULL) {
+    capture_finish(t.cap);
+  }
+  arena_free(&t.arena);
+}
+
+// The capture file is opened with O_DIRECT so archiving a run does not evict
+// the page cache or stall on writeback; filesystems without O_DIRECT support
+// (tmpfs) fall back to buffered writes.
+static int capture_open(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  if (fd < 0 && errno == EINVAL) {
+    fprintf(stderr, "%s: no O_DIRECT, using buffered writes\n", path);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if (fd < 0) {
+    perror(path);
+  }
+  return fd;
+}
+
+// Parse "12233", "12233-12240" or a comma separated list of both.
+static int parse_ports(const char *arg, std::vector<struct rx_port> *ports) {
+  const char *p = arg;
+
+  ports->clear();
+  while (*p != '\0') {
+    char *end;
+    unsigned long lo = strtoul(p, &end, 10), hi = lo;
+    if (end == p) {
+      return -1;
+    }
+    if (*end == '-') {
+      p = end + 1;
+      hi = strtoul(p, &end, 10);
+      if (end == p) {
+        return -1;
+      }
+    }
+    if (lo < 1 || hi > 65535 || lo > hi) {
+      return -1;
+    }
+    for (unsigned long port = lo; port <= hi; port++) {
+      struct rx_port rp;
+      memset(&rp, 0, sizeof(rp));
+      rp.port = (uint16_t)port;
+      rp.fd = -1;
+      ports->push_back(rp);
+    }
+    if (*end == ',') {
+      end++;
+    } else if (*end != '\0') {
+      return -1;
+    }
+    p = end;
+  }
+  return ports->empty() ? -1 : 0;
+}
+
+static int open_port(struct rx_port *port, int busy_poll_usec,
+                     int busy_poll_budget) {
+  struct sockaddr_in addr;
+  int one = 1;
+
+  if ((port->fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    perror("socket");
+    return -1;
+  }
+  if (drops &&
+      setsockopt(port->fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) {
+    perror("setsockopt(SO_RXQ_OVFL)");
+    return -1;
+  }
+  if (rx_latency && setsockopt(port->fd, SOL_SOCKET, SO_TIMESTAMPNS, &one,
+                               sizeof(one)) < 0) {
+    perror("setsockopt(SO_TIMESTAMPNS)");
+    return -1;
+  }
+  if (busy_poll_usec &&
+      enable_busy_poll(port->fd, busy_poll_usec, busy_poll_budget) < 0) {
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port->port);
+  addr.sin_addr.s_addr = inet_addr("0.0.0.0");
+  if (bind(port->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "bind port %u: %s\n", port->port, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+// Counters are cumulative in a controlled run because the periodic report,
+// which resets them, is off.
+static void rx_totals(uint64_t *p, uint64_t *b) {
+  *p = *b = 0;
+  for (const auto &port : rx_ports) {
+    *p += __atomic_load_n(&port.packets, __ATOMIC_RELAXED);
+    *b += __atomic_load_n(&port.bytes, __ATOMIC_RELAXED);
+  }
+}
+
+// Serve one controlling udpsender until it sends DONE or goes away: time
+// each window it opens and answer with what the sockets took in meanwhile.
+static int control_serve(int listen_fd, const char *result_path) {
+  std::vector<struct run_series> series = {{"rx_pps", {}}, {"rx_bps", {}}};
+  char line[CONTROL_LINE_MAX];
+  uint64_t p0 = 0, b0 = 0, t0 = 0;
+  int rep;
+
+  fprintf(stderr, "control: waiting for a sender\n");
+  int fd = accept(listen_fd, NULL, NULL);
+  close(listen_fd);
+  if (fd < 0) {
+    if (stopping) {
+      return 0;
+    }
+    perror("control accept");
+    return 1;
+  }
+  while (control_recv_line(fd, line, sizeof(line)) >= 0) {
+    if (sscanf(line, "START %d", &rep) == 1) {
+      t0 = tsc_ticks();
+      rx_totals(&p0, &b0);
+    } else if (sscanf(line, "STOP %d", &rep) == 1) {
+      uint64_t p1, b1;
+      uint64_t ns = tsc_to_ns(tsc_ticks() - t0);
+      rx_totals(&p1, &b1);
+      control_send(fd, "RESULT %d %lu %lu %lu\n", rep, p1 - p0, b1 - b0, ns);
+      series[0].values.push_back((p1 - p0) / (ns / 1e9));
+      series[1].values.push_back((b1 - b0) * 8 / (ns / 1e9));
+      printf("rep=%d rx_pps=%.0f rx_bps=%.0f\n", rep,
+             series[0].values.back(), series[1].values.back());
+    } else if (strcmp(line, "DONE") == 0) {
+      break;
+    }
+  }
+  close(fd);
+
+  run_report(stdout, "udpreceiver controlled run", series);
+  if (result_path != NULL) {
+    FILE *out = fopen(result_path, "w");
+    if (out == NULL) {
+      perror(result_path);
+      return 1;
+    }
+    run_report(out, "udpreceiver controlled run", series);
+    fclose(out);
+  }
+  return 0;
+}
+
+// Start fn on a new thread that leaves the timer and stop signals to the main
+// thread.
+template <typename Fn, typename... Args>
+static std::thread spawn_thread(Fn fn, Args... args) {
+  sigset_t mask, old;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGALRM);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, &old);
+  std::thread t(fn, args...);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return t;
+}
+
+int main(int argc, char *argv[]) {
+  bool reflect = false;
+  int batch = MSG_COUNT;
+  int msg_size = MSG_SIZE;
+  const char *xdp_ifname = NULL;
+  uint32_t xdp_queue = 0;
+  uint32_t xdp_frames = XSK_FRAMES;
+  const char *xdp_count_ifname = NULL;
+  uint32_t xdp_flags = XDP_FLAGS_SKB_MODE;
+  int busy_poll = 0;
+  int busy_poll_budget = BUSY_POLL_BUDGET;
+  uint32_t verify_seed = PATTERN_DEFAULT_SEED;
+  const char *verify_kernel = NULL;
+  pattern_verify_fn verify_fn = NULL;
+  const char *packet_ifname = NULL;
+  int ring_blocks = PACKET_BLOCKS;
+  bool count_only = false;
+  const char *port_list = NULL;
+  int threads = 1;
+  const char *capture_path = NULL;
+  uint16_t control_port = 0;
+  const char *result_path = NULL;
+  int snaplen = -1;
+
+  static const struct option long_options[] = {
+      {"reflect", no_argument, NULL, 'r'},
+      {"batch", required_argument, NULL, 'b'},
+      {"msg-size", required_argument, NULL, 's'},
+      {"xdp", required_argument, NULL, 'x'},
+      {"xdp-queue", required_argument, NULL, 'q'},
+      {"xdp-frames", required_argument, NULL, 'f'},
+      {"xdp-count", required_argument, NULL, 'c'},
+      {"xdp-native", no_argument, NULL, 'N'},
+      {"busy-poll", required_argument, NULL, 'B'},
+      {"busy-poll-budget", required_argument, NULL, 'g'},
+      {"rx-latency", no_argument, NULL, 'L'},
+      {"verify", optional_argument, NULL, 'V'},
+      {"verify-kernel", required_argument, NULL, 'K'},
+      {"packet-mmap", required_argument, NULL, 'P'},
+      {"ring-blocks", required_argument, NULL, 'R'},
+      {"drops", no_argument, NULL, 'D'},
+      {"count-only", no_argument, NULL, 'T'},
+      {"ports", required_argument, NULL, 'p'},
+      {"threads", required_argument, NULL, 't'},
+      {"capture", required_argument, NULL, 'w'},
+      {"capture-snaplen", required_argument, NULL, 'S'},
+      {"control", required_argument, NULL, 'C'},
+      {"result", required_argument, NULL, 'o'},
+      {"cpu-report", no_argument, NULL, 'U'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv,
+                            "rb:s:x:q:f:c:NB:g:LV::K:P:R:DTp:t:w:S:C:o:Uh",
+                            long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'r':
+      reflect = true;
+      break;
+    case 'b':
+      batch = atoi(optarg);
+      if (batch < 1 || batch > MAX_BATCH) {
+        fprintf(stderr, "--batch must be between 1 and %d\n", MAX_BATCH);
+        return 1;
+      }
+      break;
+    case 's':
+      msg_size = atoi(optarg);
+      if (msg_size < 1 || msg_size > 65535) {
+        fprintf(stderr, "--msg-size must be between 1 and 65535\n");
+        return 1;
+      }
+      break;
+    case 'x':
+      xdp_ifname = optarg;
+      break;
+    case 'q':
+      xdp_queue = atoi(optarg);
+      break;
+    case 'f':
+      xdp_frames = atoi(optarg);
+      if (xdp_frames < 64 || (xdp_frames & (xdp_frames - 1)) != 0) {
+        fprintf(stderr, "--xdp-frames must be a power of two >= 64\n");
+        return 1;
       }
+      break;
+    case 'c':
+      xdp_count_ifname = optarg;
+      break;
+    case 'N':
+      xdp_flags = XDP_FLAGS_DRV_MODE;
+      break;
+    case 'B':
+      busy_poll = atoi(optarg);
+      if (busy_poll < 1) {
+        fprintf(stderr, "--busy-poll must be a positive number of usecs\n");
+        return 1;
+      }
+      break;
+    case 'g':
+      busy_poll_budget = atoi(optarg);
+      break;
+    case 'L':
+      rx_latency = true;
+      break;
+    case 'V':
+      verify = true;
+      if (optarg != NULL) {
+        verify_seed = strtoul(optarg, NULL, 0);
+      }
+      break;
+    case 'K':
+      verify_kernel = optarg;
+      break;
+    case 'P':
+      packet_ifname = optarg;
+      break;
+    case 'D':
+      drops = true;
+      break;
+    case 'T':
+      count_only = true;
+      break;
+    case 'R':
+      ring_blocks = atoi(optarg);
+      if (ring_blocks < 1) {
+        fprintf(stderr, "--ring-blocks must be positive\n");
+        return 1;
+      }
+      break;
+    case 'p':
+      port_list = optarg;
+      break;
+    case 't':
+      threads = atoi(optarg);
+      if (threads < 1) {
+        fprintf(stderr, "--threads must be positive\n");
+        return 1;
+      }
+      break;
+    case 'w':
+      capture_path = optarg;
+      break;
+    case 'S':
+      snaplen = atoi(optarg);
+      if (snaplen < 0) {
+        fprintf(stderr, "--capture-snaplen must not be negative\n");
+        return 1;
+      }
+      break;
+    case 'C':
+      control_port = atoi(optarg);
+      if (control_port == 0) {
+        fprintf(stderr, "--control needs a TCP port\n");
+        return 1;
+      }
+      break;
+    case 'o':
+      result_path = optarg;
+      break;
+    case 'U':
+      cpu_report = true;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (port_list == NULL) {
+    struct rx_port rp;
+    memset(&rp, 0, sizeof(rp));
+    rp.port = PORT;
+    rp.fd = -1;
+    rx_ports.push_back(rp);
+  } else if (parse_ports(port_list, &rx_ports) < 0) {
+    fprintf(stderr, "bad --ports list: %s\n", port_list);
+    return 1;
+  }
+
+  if (count_only && (verify || reflect)) {
+    fprintf(stderr, "--count-only never sees payloads; it cannot be combined "
+                    "with --verify or --reflect\n");
+    return 1;
+  }
+  // The kernel still reports each datagram's full length through MSG_TRUNC,
+  // but copies nothing into the zero-length iovecs.
+  if (count_only) {
+    msg_size = 0;
+  }
+  if ((size_t)threads > rx_ports.size()) {
+    threads = (int)rx_ports.size();
+  }
+  // Set up before the timer, which reads these from the signal handler.
+  if (cpu_report && cpu_report_init(threads) < 0) {
+    return 1;
+  }
+
+  if (verify) {
+    const char *name;
+    verify_fn = pattern_select_verify(verify_kernel, &name);
+    if (verify_fn == NULL) {
+      fprintf(stderr, "verify kernel %s is not supported here\n", name);
+      return 1;
+    }
+    fprintf(stderr, "verify: %s kernel, seed %#x\n", name, verify_seed);
+  }
+
+  if (tsc_clock_init()) {
+    fprintf(stderr, "clock: tsc, %.3f GHz\n", tsc_clock_ghz());
+  } else {
+    fprintf(stderr, "clock: CLOCK_MONOTONIC (TSC not usable)\n");
+  }
+
+  if (control_port != 0 && (xdp_ifname != NULL || xdp_count_ifname != NULL)) {
+    fprintf(stderr, "--control works with socket receive only\n");
+    return 1;
+  }
+
+  // Timer hook using SIGALRM; a controlled run reports per window instead.
+  if (control_port == 0) {
+    getrusage(RUSAGE_SELF, &last_usage);
+    clock_gettime(CLOCK_MONOTONIC, &last_wall);
+    signal(SIGALRM, timer_handler);
+    struct itimerval timer = {0};
+    timer.it_value.tv_sec = 1;
+    timer.it_interval.tv_sec = 1;
+    setitimer(ITIMER_REAL, &timer, NULL);
+  }
+
+  // The XDP modes match a single port: the first one listed.
+  if (xdp_ifname != NULL) {
+    return run_afxdp(xdp_ifname, rx_ports[0].port, xdp_queue, xdp_frames,
+                     xdp_flags);
+  }
+  if (xdp_count_ifname != NULL) {
+    return run_xdp_count(xdp_count_ifname, rx_ports[0].port, xdp_flags);
+  }
+
+  rx_cfg.reflect = reflect;
+  rx_cfg.verify_fn = verify_fn;
+  rx_cfg.verify_seed = verify_seed;
+  rx_cfg.batch = batch;
+  rx_cfg.msg_size = msg_size;
+  rx_cfg.busy_poll = busy_poll != 0;
+  rx_cfg.ctrl_size = 0;
+  if (rx_latency) {
+    rx_cfg.ctrl_size += CMSG_SPACE(sizeof(struct timespec));
+  }
+  if (drops) {
+    rx_cfg.ctrl_size += CMSG_SPACE(sizeof(uint32_t));
+  }
+  // Busy polling spins in userspace as well instead of sleeping in recvmmsg.
+  rx_cfg.recv_flags = busy_poll ? MSG_DONTWAIT : MSG_WAITFORONE;
+  if (count_only) {
+    rx_cfg.recv_flags |= MSG_TRUNC;
+  }
+
+  if (capture_path != NULL) {
+    // By default every received byte is kept.
+    capture_snaplen = snaplen < 0 ? (uint32_t)msg_size : (uint32_t)snaplen;
+    if ((capture_fd = capture_open(capture_path)) < 0) {
+      return 1;
     }
   }
 
-  close(sockfd);
+  uint16_t lo = rx_ports[0].port, hi = rx_ports[0].port;
+  for (auto &port : rx_ports) {
+    if (open_port(&port, busy_poll, busy_poll_budget) < 0) {
+      return 1;
+    }
+    lo = port.port < lo ? port.port : lo;
+    hi = port.port > hi ? port.port : hi;
+  }
+  if (drops) {
+    read_udp_snmp(&last_snmp);
+  }
 
-  exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+  // The ring runs beside the sockets: they keep the host from answering with
+  // port unreachables and provide the "delivered" side of the report.
+  if (packet_ifname != NULL) {
+    struct packet_ring ring;
+    int fd = packet_ring_open(packet_ifname, lo, hi, ring_blocks, &ring);
+    if (fd < 0) {
+      return 1;
+    }
+    spawn_thread(packet_ring_loop, fd, ring).detach();
+    packet_fd = fd;
+  }
+
+  // Ports are dealt round-robin; a worker left with one port blocks in
+  // recvmmsg, one with several multiplexes them through epoll.
+  std::vector<std::vector<struct rx_port *>> assigned(threads);
+  for (size_t i = 0; i < rx_ports.size(); i++) {
+    assigned[i % threads].push_back(&rx_ports[i]);
+  }
+  int control_fd = -1;
+  if (control_port != 0 && (control_fd = control_listen(control_port)) < 0) {
+    return 1;
+  }
+  // No SA_RESTART, so a stop signal also breaks out of the control socket.
+  struct sigaction stop;
+  memset(&stop, 0, sizeof(stop));
+  stop.sa_handler = stop_handler;
+  sigaction(SIGINT, &stop, NULL);
+  sigaction(SIGTERM, &stop, NULL);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < assigned.size() && cpu_report; i++) {
+    for (struct rx_port *port : assigned[i]) {
+      if (cpu_report_attach(&rx_cpu_stats[i], port->fd) < 0) {
+        return 1;
+      }
+    }
+  }
+  for (size_t i = 0; i < assigned.size(); i++) {
+    workers.push_back(spawn_thread(rx_worker, assigned[i], i));
+  }
+
+  int status = 0;
+  if (control_fd >= 0) {
+    status = control_serve(control_fd, result_path);
+    stopping = 1;
+  }
+  while (!stopping) {
+    pause();
+  }
+
+  // Shutting down the read side wakes workers blocked in recvmmsg or
+  // epoll_wait; unconnected UDP sockets report ENOTCONN but still wake.
+  for (auto &port : rx_ports) {
+    shutdown(port.fd, SHUT_RD);
+  }
+  for (auto &t : workers) {
+    t.join();
+  }
+  if (capture_fd >= 0) {
+    fprintf(stderr, "capture: %lu bytes written\n",
+            __atomic_load_n(&capture_offset, __ATOMIC_RELAXED));
+    close(capture_fd);
+  }
+
+  return status;
+}
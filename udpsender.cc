@@ -1,11 +1,15 @@
 #include <arpa/inet.h>
+#include <getopt.h>
 #include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <cerrno>
 #include <cstring>
@@ -16,27 +20,247 @@
 #include <vector>
 #include <iostream>
 
+#include "hdr_histogram.h"
+#include "payload_pattern.h"
+#include "run_control.h"
+#include "tsc_clock.h"
+
 #define MSG_COUNT 1024
 #define MSG_SIZE 32
+// Largest UDP payload over IPv4.
+#define MSG_SIZE_MAX 65507
+// Outstanding requests are declared lost after this long without a reply.
+#define LATENCY_TIMEOUT_MS 200
+#define CLOCK_BENCH_ITERATIONS 10000000
+#define RUN_WARMUP_S 2
+// Synthetic flows use source ports FLOW_SPORT_MIN..65535 of each source
+// address before moving on to the next address.
+#define FLOW_SPORT_MIN 1024
+#define FLOW_SPORTS (65536 - FLOW_SPORT_MIN)
+// RFC 2544 benchmarking range.
+#define FLOW_SRC_BASE "198.18.0.0"
 
 std::mutex mtx;
 
 static uint64_t packets = 0;
 static uint64_t bytes = 0;
+static bool latency_mode = false;
+// Datagram size of the blast and --verify modes (--msg-size).
+static size_t msg_size = MSG_SIZE;
+static uint64_t lost = 0;
+// Round-trip times in TSC ticks; converted to ns only when reported.
+static struct hdr_histogram rtt_hist;
+// Workers start together once every socket is ready, and stop at the end of
+// a benchmark run.
+static pthread_barrier_t start_barrier;
+static bool running = true;
+
+static bool keep_running() {
+  return __atomic_load_n(&running, __ATOMIC_RELAXED);
+}
 static void timer_handler(int signo) {
-  printf("packets=%lu bytes=%lu\n", packets, bytes);
+  if (!latency_mode) {
+    printf("packets=%lu bytes=%lu\n", packets, bytes);
+    packets = 0;
+    bytes = 0;
+    return;
+  }
+  // Workers block SIGALRM, so this runs on the main thread, which never holds
+  // the lock otherwise.
+  std::lock_guard<std::mutex> lock(mtx);
+  printf("packets=%lu bytes=%lu lost=%lu rtt_us p50=%.1f p99=%.1f "
+         "p99.9=%.1f max=%.1f\n",
+         packets, bytes, lost,
+         hdr_percentile(&rtt_hist, 50.0) / 1e3,
+         hdr_percentile(&rtt_hist, 99.0) / 1e3,
+         hdr_percentile(&rtt_hist, 99.9) / 1e3,
+         rtt_hist.max / 1e3);
   packets = 0;
   bytes = 0;
+  lost = 0;
+  hdr_reset(&rtt_hist);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--latency] [--inflight N] [--verify[=SEED]] "
+          "[--msg-size BYTES] ip:port [ip:port ...]\n"
+          "       %s [--warmup SEC] --duration SEC [--repeat N] "
+          "[--result FILE] [--control IP:PORT] ip:port ...\n"
+          "       %s --flows N [--src-base IP] ip:port ...\n"
+          "       %s --clock-bench\n"
+          "  --latency        ping-pong against a udpreceiver --reflect and "
+          "report RTT percentiles\n"
+          "  --inflight N     requests kept outstanding per destination "
+          "(default 1)\n"
+          "  --verify[=SEED]  fill payloads with a pattern udpreceiver "
+          "--verify can check\n"
+          "  --msg-size BYTES datagram size without --latency or --flows "
+          "(default %d, max %d)\n"
+          "  --duration SEC   benchmark run: measure for SEC seconds per "
+          "repetition, then exit\n"
+          "  --warmup SEC     unmeasured traffic before each repetition "
+          "(default %d)\n"
+          "  --repeat N       repetitions (default 1)\n"
+          "  --result FILE    also write the run summary to FILE\n"
+          "  --control IP:PORT\n"
+          "                   open and close the windows of a udpreceiver "
+          "--control and report its rates too\n"
+          "  --flows N        raw IP_HDRINCL datagrams cycling through N "
+          "source address/port flows\n"
+          "  --src-base IP    first source address of --flows (default %s)\n"
+          "  --clock-bench    measure the cost of each timestamp source and "
+          "exit\n",
+          prog, prog, prog, prog, MSG_SIZE, MSG_SIZE_MAX, RUN_WARMUP_S,
+          FLOW_SRC_BASE);
 }
 
 void send_udp(int sockfd, mmsghdr *msg) {
   int retval;
-  while (true) {
+  pthread_barrier_wait(&start_barrier);
+  while (keep_running()) {
+    retval = sendmmsg(sockfd, msg, MSG_COUNT, 0);
+    if (retval < 0) {
+      perror("Failed to sendmmsg");
+      std::exit(1);
+    } else {
+      std::lock_guard<std::mutex> lock(mtx);
+      packets += retval;
+      bytes += retval * msg_size;
+    }
+  }
+}
+
+// Like send_udp, but every datagram carries its own sequence number and the
+// seeded pattern derived from it, so each thread needs private buffers.
+void send_udp_pattern(int sockfd, uint32_t seed) {
+  struct mmsghdr msg[MSG_COUNT];
+  struct iovec iov[MSG_COUNT];
+  std::vector<char> bufs(MSG_COUNT * msg_size);
+  uint32_t seq = 0;
+  int retval;
+
+  memset(msg, 0, sizeof(msg));
+  for (int i = 0; i < MSG_COUNT; i++) {
+    iov[i].iov_base = &bufs[i * msg_size];
+    iov[i].iov_len = msg_size;
+    msg[i].msg_hdr.msg_iov = &iov[i];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  pthread_barrier_wait(&start_barrier);
+  while (keep_running()) {
+    for (int i = 0; i < MSG_COUNT; i++) {
+      pattern_fill(&bufs[i * msg_size], msg_size, seed, seq++);
+    }
+    retval = sendmmsg(sockfd, msg, MSG_COUNT, 0);
+    if (retval < 0) {
+      perror("Failed to sendmmsg");
+      std::exit(1);
+    } else {
+      // Unsent tail slots are regenerated with fresh sequence numbers.
+      seq -= MSG_COUNT - retval;
+      std::lock_guard<std::mutex> lock(mtx);
+      packets += retval;
+      bytes += retval * msg_size;
+    }
+  }
+}
+
+// One's complement sum of 16-bit words, not yet folded.
+static uint32_t csum_add(uint32_t sum, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i + 1 < len; i += 2) {
+    sum += (uint32_t)(p[i] << 8 | p[i + 1]);
+  }
+  if (len & 1) {
+    sum += (uint32_t)p[len - 1] << 8;
+  }
+  return sum;
+}
+
+static uint16_t csum_fold(uint32_t sum) {
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t)sum;
+}
+
+// Raw sender for flow-table stress: every datagram of a batch belongs to the
+// next of flows synthetic 5-tuples. Headers come from a template, and only
+// the source address, source port and UDP checksum are rewritten per packet.
+// The checksum is updated incrementally (RFC 1624): the template's words are
+// subtracted once, so each packet only adds its own three words. The kernel
+// always fills in the IP header checksum for IP_HDRINCL.
+void send_raw_flows(int sockfd, struct sockaddr_in dst, uint32_t flows,
+                    uint32_t src_base) {
+  const size_t hdr_len = sizeof(struct iphdr) + sizeof(struct udphdr);
+  const size_t pkt_len = hdr_len + MSG_SIZE;
+  struct mmsghdr msg[MSG_COUNT];
+  struct iovec iov[MSG_COUNT];
+  char bufs[MSG_COUNT][hdr_len + MSG_SIZE];
+  uint32_t flow = 0;
+  int retval;
+
+  struct iphdr ip;
+  memset(&ip, 0, sizeof(ip));
+  ip.version = 4;
+  ip.ihl = 5;
+  ip.ttl = 64;
+  ip.protocol = IPPROTO_UDP;
+  ip.tot_len = htons(pkt_len);
+  ip.saddr = htonl(src_base);
+  ip.daddr = dst.sin_addr.s_addr;
+  struct udphdr udp;
+  memset(&udp, 0, sizeof(udp));
+  udp.source = htons(FLOW_SPORT_MIN);
+  udp.dest = dst.sin_port;
+  udp.len = htons(sizeof(udp) + MSG_SIZE);
+
+  // Pseudo-header, UDP header and the all-zero payload of the template flow.
+  uint32_t sum = csum_add(0, &ip.saddr, 8);
+  sum += IPPROTO_UDP + ntohs(udp.len);
+  sum = csum_add(sum, &udp, sizeof(udp));
+  uint16_t check = ~csum_fold(sum);
+  udp.check = htons(check ? check : 0xffff);
+  // ~HC + ~m for the three words that change from flow to flow.
+  uint32_t base = (uint16_t)~check + (uint16_t)~(src_base >> 16) +
+                  (uint16_t)~(src_base & 0xffff) +
+                  (uint16_t)~FLOW_SPORT_MIN;
+
+  memset(msg, 0, sizeof(msg));
+  memset(bufs, 0, sizeof(bufs));
+  for (int i = 0; i < MSG_COUNT; i++) {
+    memcpy(bufs[i], &ip, sizeof(ip));
+    memcpy(bufs[i] + sizeof(ip), &udp, sizeof(udp));
+    iov[i].iov_base = bufs[i];
+    iov[i].iov_len = pkt_len;
+    msg[i].msg_hdr.msg_iov = &iov[i];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  pthread_barrier_wait(&start_barrier);
+  while (keep_running()) {
+    for (int i = 0; i < MSG_COUNT; i++) {
+      struct iphdr *pip = (struct iphdr *)bufs[i];
+      struct udphdr *pudp = (struct udphdr *)(bufs[i] + sizeof(ip));
+      uint32_t saddr = src_base + flow / FLOW_SPORTS;
+      uint16_t sport = FLOW_SPORT_MIN + flow % FLOW_SPORTS;
+      uint16_t c = ~csum_fold(base + (saddr >> 16) + (saddr & 0xffff) + sport);
+      pip->saddr = htonl(saddr);
+      pudp->source = htons(sport);
+      pudp->check = htons(c ? c : 0xffff);
+      flow = flow + 1 == flows ? 0 : flow + 1;
+    }
     retval = sendmmsg(sockfd, msg, MSG_COUNT, 0);
     if (retval < 0) {
+      if (errno == ENOBUFS) {
+        continue;
+      }
       perror("Failed to sendmmsg");
       std::exit(1);
     } else {
+      // Unsent tail slots are rewritten with the flows that follow them.
+      flow = (flow + flows - (uint32_t)((MSG_COUNT - retval) % flows)) % flows;
       std::lock_guard<std::mutex> lock(mtx);
       packets += retval;
       bytes += retval * MSG_SIZE;
@@ -44,23 +268,369 @@ void send_udp(int sockfd, mmsghdr *msg) {
   }
 }
 
+// Request header carried at the start of every latency-mode datagram and
+// echoed back unchanged by the reflector.
+struct probe {
+  uint64_t seq;
+  uint64_t tx_tsc;
+};
+
+// Stamp and send count requests, in batches of at most MSG_COUNT.
+static void send_probes(int sockfd, mmsghdr *msg, char (*bufs)[MSG_SIZE],
+                        int count, uint64_t *seq) {
+  while (count > 0) {
+    int batch = count < MSG_COUNT ? count : MSG_COUNT;
+    uint64_t now = tsc_ticks();
+    for (int i = 0; i < batch; i++) {
+      struct probe *p = (struct probe *)bufs[i];
+      p->seq = (*seq)++;
+      p->tx_tsc = now;
+    }
+    int sent = 0;
+    while (sent < batch) {
+      int retval = sendmmsg(sockfd, msg + sent, batch - sent, 0);
+      if (retval < 0) {
+        perror("Failed to sendmmsg");
+        std::exit(1);
+      }
+      sent += retval;
+    }
+    count -= batch;
+  }
+}
+
+// Keep inflight requests outstanding on a connected socket and record the
+// round-trip time of every reply.
+void pingpong_udp(int sockfd, int inflight) {
+  struct mmsghdr tx_msg[MSG_COUNT], rx_msg[MSG_COUNT];
+  struct iovec tx_iov[MSG_COUNT], rx_iov[MSG_COUNT];
+  char tx_bufs[MSG_COUNT][MSG_SIZE], rx_bufs[MSG_COUNT][MSG_SIZE];
+  uint64_t rtts[MSG_COUNT];
+  uint64_t seq = 0;
+  int outstanding = 0;
+
+  memset(tx_msg, 0, sizeof(tx_msg));
+  memset(rx_msg, 0, sizeof(rx_msg));
+  memset(tx_bufs, 0, sizeof(tx_bufs));
+  for (int i = 0; i < MSG_COUNT; i++) {
+    tx_iov[i].iov_base = tx_bufs[i];
+    tx_iov[i].iov_len = MSG_SIZE;
+    tx_msg[i].msg_hdr.msg_iov = &tx_iov[i];
+    tx_msg[i].msg_hdr.msg_iovlen = 1;
+    rx_iov[i].iov_base = rx_bufs[i];
+    rx_iov[i].iov_len = MSG_SIZE;
+    rx_msg[i].msg_hdr.msg_iov = &rx_iov[i];
+    rx_msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  struct timeval tv = {0};
+  tv.tv_usec = LATENCY_TIMEOUT_MS * 1000;
+  if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+    perror("Failed to set SO_RCVTIMEO");
+    std::exit(1);
+  }
+
+  pthread_barrier_wait(&start_barrier);
+  while (keep_running()) {
+    // Top the window up; late replies only ever make it overshoot briefly.
+    if (outstanding < inflight) {
+      send_probes(sockfd, tx_msg, tx_bufs,
+                  inflight - outstanding, &seq);
+      outstanding = inflight;
+    }
+
+    int retval = recvmmsg(sockfd, rx_msg, MSG_COUNT, MSG_WAITFORONE,
+                          NULL);
+    if (retval < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        std::lock_guard<std::mutex> lock(mtx);
+        lost += outstanding;
+        outstanding = 0;
+        continue;
+      }
+      if (errno == EINTR || errno == ECONNREFUSED) {
+        continue;
+      }
+      perror("Failed to recvmmsg");
+      std::exit(1);
+    }
+
+    uint64_t now = tsc_ticks();
+    int valid = 0;
+    for (int i = 0; i < retval; i++) {
+      if (rx_msg[i].msg_len < sizeof(struct probe)) {
+        continue;
+      }
+      const struct probe *p = (const struct probe *)rx_bufs[i];
+      rtts[valid++] = tsc_to_ns(now - p->tx_tsc);
+    }
+    outstanding = outstanding > retval ? outstanding - retval : 0;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    packets += retval;
+    bytes += retval * MSG_SIZE;
+    for (int i = 0; i < valid; i++) {
+      hdr_record(&rtt_hist, rtts[i]);
+    }
+  }
+}
+
+// Benchmark run settings (--duration and friends).
+struct run_config {
+  double warmup;
+  double duration;
+  int repeat;
+  const char *result_path;
+  int control_fd;
+};
+
+static void sleep_seconds(double seconds) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)seconds;
+  ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+  }
+}
+
+static void count_snapshot(uint64_t *p, uint64_t *b) {
+  std::lock_guard<std::mutex> lock(mtx);
+  *p = packets;
+  *b = bytes;
+}
+
+// Drive warmup and measurement windows while the workers send, then stop
+// them. Rates are taken from counter deltas over TSC-timed windows; with a
+// control connection the receiver measures the same windows on its side.
+static int run_benchmark(const struct run_config *cfg) {
+  std::vector<struct run_series> series = {
+      {"tx_pps", {}}, {"tx_bps", {}}, {"rx_pps", {}}, {"rx_bps", {}}};
+  size_t columns = cfg->control_fd >= 0 ? 4 : 2;
+  int status = 0;
+
+  for (int rep = 1; rep <= cfg->repeat && status == 0; rep++) {
+    uint64_t p0, b0, p1, b1;
+    sleep_seconds(cfg->warmup);
+    if (cfg->control_fd >= 0 &&
+        control_send(cfg->control_fd, "START %d\n", rep) < 0) {
+      perror("control send");
+      status = 1;
+      break;
+    }
+    uint64_t t0 = tsc_ticks();
+    count_snapshot(&p0, &b0);
+    sleep_seconds(cfg->duration);
+    uint64_t t1 = tsc_ticks();
+    count_snapshot(&p1, &b1);
+
+    double secs = tsc_to_ns(t1 - t0) / 1e9;
+    series[0].values.push_back((p1 - p0) / secs);
+    series[1].values.push_back((b1 - b0) * 8 / secs);
+    printf("rep=%d tx_pps=%.0f tx_bps=%.0f", rep, series[0].values.back(),
+           series[1].values.back());
+
+    if (cfg->control_fd >= 0) {
+      char line[CONTROL_LINE_MAX];
+      int rx_rep;
+      unsigned long rx_packets, rx_bytes, rx_ns;
+      if (control_send(cfg->control_fd, "STOP %d\n", rep) < 0 ||
+          control_recv_line(cfg->control_fd, line, sizeof(line)) < 0 ||
+          sscanf(line, "RESULT %d %lu %lu %lu", &rx_rep, &rx_packets,
+                 &rx_bytes, &rx_ns) != 4 ||
+          rx_rep != rep || rx_ns == 0) {
+        fprintf(stderr, "\nbad or missing reply from the receiver\n");
+        status = 1;
+        break;
+      }
+      series[2].values.push_back(rx_packets / (rx_ns / 1e9));
+      series[3].values.push_back(rx_bytes * 8 / (rx_ns / 1e9));
+      printf(" rx_pps=%.0f rx_bps=%.0f", series[2].values.back(),
+             series[3].values.back());
+    }
+    printf("\n");
+  }
+
+  __atomic_store_n(&running, false, __ATOMIC_RELAXED);
+  if (cfg->control_fd >= 0) {
+    control_send(cfg->control_fd, "DONE\n");
+    close(cfg->control_fd);
+  }
+  if (status != 0) {
+    return status;
+  }
+
+  series.resize(columns);
+  char header[128];
+  snprintf(header, sizeof(header),
+           "udpsender warmup=%gs duration=%gs repeat=%d", cfg->warmup,
+           cfg->duration, cfg->repeat);
+  run_report(stdout, header, series);
+  if (cfg->result_path != NULL) {
+    FILE *out = fopen(cfg->result_path, "w");
+    if (out == NULL) {
+      perror(cfg->result_path);
+      return 1;
+    }
+    run_report(out, header, series);
+    fclose(out);
+  }
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
   struct mmsghdr msg[MSG_COUNT];
   struct iovec iov;
+  int inflight = 1;
+  bool verify = false;
+  uint32_t flows = 0;
+  const char *src_base = FLOW_SRC_BASE;
+  uint32_t verify_seed = PATTERN_DEFAULT_SEED;
+  bool clock_bench = false;
+  struct run_config run = {RUN_WARMUP_S, 0, 1, NULL, -1};
+  const char *control = NULL;
 
   std::vector<std::thread> threads;
 
-  // Timer hook using SIGALRM
-  signal(SIGALRM, timer_handler);
-  struct itimerval timer = {0};
-  timer.it_value.tv_sec = 1;
-  timer.it_interval.tv_sec = 1;
-  setitimer(ITIMER_REAL, &timer, NULL);
+  static const struct option long_options[] = {
+      {"latency", no_argument, NULL, 'l'},
+      {"inflight", required_argument, NULL, 'n'},
+      {"verify", optional_argument, NULL, 'V'},
+      {"msg-size", required_argument, NULL, 's'},
+      {"clock-bench", no_argument, NULL, 'C'},
+      {"warmup", required_argument, NULL, 'w'},
+      {"duration", required_argument, NULL, 'd'},
+      {"repeat", required_argument, NULL, 'r'},
+      {"result", required_argument, NULL, 'o'},
+      {"control", required_argument, NULL, 'c'},
+      {"flows", required_argument, NULL, 'F'},
+      {"src-base", required_argument, NULL, 'S'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "ln:V::s:Cw:d:r:o:c:F:S:h", long_options,
+                            NULL)) != -1) {
+    switch (opt) {
+    case 'l':
+      latency_mode = true;
+      break;
+    case 'n':
+      inflight = std::stoi(optarg);
+      if (inflight < 1) {
+        fprintf(stderr, "--inflight must be at least 1\n");
+        return 1;
+      }
+      break;
+    case 'V':
+      verify = true;
+      if (optarg != NULL) {
+        verify_seed = strtoul(optarg, NULL, 0);
+      }
+      break;
+    case 's':
+      msg_size = std::stoul(optarg);
+      if (msg_size < sizeof(struct pattern_header) ||
+          msg_size > MSG_SIZE_MAX) {
+        fprintf(stderr, "--msg-size must be between %zu and %d\n",
+                sizeof(struct pattern_header), MSG_SIZE_MAX);
+        return 1;
+      }
+      break;
+    case 'C':
+      clock_bench = true;
+      break;
+    case 'w':
+      run.warmup = std::stod(optarg);
+      if (run.warmup < 0) {
+        fprintf(stderr, "--warmup must not be negative\n");
+        return 1;
+      }
+      break;
+    case 'd':
+      run.duration = std::stod(optarg);
+      if (run.duration <= 0) {
+        fprintf(stderr, "--duration must be positive\n");
+        return 1;
+      }
+      break;
+    case 'r':
+      run.repeat = std::stoi(optarg);
+      if (run.repeat < 1) {
+        fprintf(stderr, "--repeat must be at least 1\n");
+        return 1;
+      }
+      break;
+    case 'o':
+      run.result_path = optarg;
+      break;
+    case 'c':
+      control = optarg;
+      break;
+    case 'F':
+      flows = std::stoul(optarg);
+      if (flows < 1) {
+        fprintf(stderr, "--flows must be at least 1\n");
+        return 1;
+      }
+      break;
+    case 'S':
+      src_base = optarg;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
 
-  // Prepare message content
+  if (tsc_clock_init()) {
+    fprintf(stderr, "clock: tsc, %.3f GHz\n", tsc_clock_ghz());
+  } else {
+    fprintf(stderr, "clock: CLOCK_MONOTONIC (TSC not usable)\n");
+  }
+  if (clock_bench) {
+    tsc_clock_bench(CLOCK_BENCH_ITERATIONS);
+    return 0;
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (flows && (latency_mode || verify)) {
+    fprintf(stderr, "--flows cannot be combined with --latency or --verify\n");
+    return 1;
+  }
+  if ((flows || latency_mode) && msg_size != MSG_SIZE) {
+    fprintf(stderr, "--msg-size cannot be combined with --latency or --flows\n");
+    return 1;
+  }
+
+  if (control != NULL) {
+    if (run.duration == 0) {
+      fprintf(stderr, "--control needs --duration\n");
+      return 1;
+    }
+    if ((run.control_fd = control_connect(control)) < 0) {
+      return 1;
+    }
+  }
+
+  // Timer hook using SIGALRM; a benchmark run reports once at the end.
+  if (run.duration == 0) {
+    signal(SIGALRM, timer_handler);
+    struct itimerval timer = {0};
+    timer.it_value.tv_sec = 1;
+    timer.it_interval.tv_sec = 1;
+    setitimer(ITIMER_REAL, &timer, NULL);
+  }
+  pthread_barrier_init(&start_barrier, NULL, argc - optind + 1);
+
+  // Prepare message content; every datagram of send_udp shares it.
+  std::vector<char> payload(msg_size);
   memset(&iov, 0, sizeof(iov));
-  iov.iov_base = (void *)std::string(MSG_SIZE, '\x00').c_str();
-  iov.iov_len = MSG_SIZE;
+  iov.iov_base = payload.data();
+  iov.iov_len = msg_size;
 
   // Fill each message
   memset(msg, 0, sizeof(msg));
@@ -69,13 +639,20 @@ int main(int argc, char *argv[]) {
     msg[i].msg_hdr.msg_iovlen = 1;
   }
 
-  for (int i = 1; i < argc; i++) {
+  // Only the main thread takes SIGALRM; workers inherit the blocked mask.
+  sigset_t alrm;
+  sigemptyset(&alrm);
+  sigaddset(&alrm, SIGALRM);
+  pthread_sigmask(SIG_BLOCK, &alrm, NULL);
+
+  for (int i = optind; i < argc; i++) {
     // Declare variables
     struct sockaddr_in servaddr;
     int sockfd;
 
-    // Create socket
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    // Create socket; IPPROTO_RAW implies IP_HDRINCL
+    if ((sockfd = flows ? socket(AF_INET, SOCK_RAW, IPPROTO_RAW)
+                        : socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
       perror("Failed to create socket");
       std::exit(1);
     }
@@ -108,13 +685,29 @@ int main(int argc, char *argv[]) {
       std::exit(1);
     }
 
-    threads.push_back(
-        std::thread(send_udp, std::move(sockfd), msg));
+    if (flows) {
+      threads.push_back(std::thread(send_raw_flows, sockfd, servaddr, flows,
+                                    ntohl(inet_addr(src_base))));
+    } else if (latency_mode) {
+      threads.push_back(std::thread(pingpong_udp, sockfd, inflight));
+    } else if (verify) {
+      threads.push_back(std::thread(send_udp_pattern, sockfd, verify_seed));
+    } else {
+      threads.push_back(
+          std::thread(send_udp, std::move(sockfd), msg));
+    }
   }
 
+  pthread_sigmask(SIG_UNBLOCK, &alrm, NULL);
+  pthread_barrier_wait(&start_barrier);
+
+  int status = 0;
+  if (run.duration > 0) {
+    status = run_benchmark(&run);
+  }
   for (auto &t : threads) {
     t.join();
   }
 
-  return 0;
+  return status;
 }
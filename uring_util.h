@@ -0,0 +1,148 @@
+#ifndef URING_UTIL_H
+#define URING_UTIL_H
+
+// Minimal io_uring plumbing on top of the raw syscalls, so udpreceiver does
+// not need liburing. One submitter thread per ring, no SQPOLL.
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct uring {
+  int fd;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+  // SQEs filled in but not yet passed to io_uring_enter.
+  unsigned pending;
+  void *sq_map;
+  size_t sq_len;
+  void *cq_map;
+  size_t cq_len;
+  size_t sqes_len;
+};
+
+static inline int sys_io_uring_setup(unsigned entries,
+                                     struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit,
+                                     unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      NULL, 0);
+}
+
+static inline int uring_init(struct uring *r, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  memset(r, 0, sizeof(*r));
+
+  r->fd = sys_io_uring_setup(entries, &p);
+  if (r->fd < 0) {
+    perror("io_uring_setup");
+    return -1;
+  }
+  r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  // Since 5.4 both rings share one mapping.
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    r->sq_len = r->cq_len = r->sq_len > r->cq_len ? r->sq_len : r->cq_len;
+  }
+  r->sq_map = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (r->sq_map == MAP_FAILED) {
+    perror("mmap io_uring sq");
+    return -1;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    r->cq_map = r->sq_map;
+  } else {
+    r->cq_map = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_map == MAP_FAILED) {
+      perror("mmap io_uring cq");
+      return -1;
+    }
+  }
+  r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = (struct io_uring_sqe *)mmap(NULL, r->sqes_len,
+                                        PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, r->fd,
+                                        IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) {
+    perror("mmap io_uring sqes");
+    return -1;
+  }
+
+  char *sq = (char *)r->sq_map, *cq = (char *)r->cq_map;
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return 0;
+}
+
+// Next free SQE, zeroed, or NULL if the submission queue is full.
+static inline struct io_uring_sqe *uring_get_sqe(struct uring *r) {
+  unsigned tail = *r->sq_tail;
+  if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) > r->sq_mask) {
+    return NULL;
+  }
+  unsigned index = tail & r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  r->sq_array[index] = index;
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  r->pending++;
+  return sqe;
+}
+
+// Pass pending SQEs to the kernel, optionally waiting for completions.
+static inline int uring_submit(struct uring *r, unsigned wait_nr) {
+  int ret = sys_io_uring_enter(r->fd, r->pending, wait_nr,
+                               wait_nr ? IORING_ENTER_GETEVENTS : 0);
+  if (ret >= 0) {
+    r->pending -= (unsigned)ret;
+  }
+  return ret;
+}
+
+// Oldest unconsumed completion, or NULL. Release it with uring_cqe_seen().
+static inline struct io_uring_cqe *uring_peek_cqe(struct uring *r) {
+  unsigned head = *r->cq_head;
+  if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &r->cqes[head & r->cq_mask];
+}
+
+static inline void uring_cqe_seen(struct uring *r) {
+  __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static inline void uring_free(struct uring *r) {
+  munmap(r->sqes, r->sqes_len);
+  if (r->cq_map != r->sq_map) {
+    munmap(r->cq_map, r->cq_len);
+  }
+  munmap(r->sq_map, r->sq_len);
+  close(r->fd);
+}
+
+#endif